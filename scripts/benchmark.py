@@ -0,0 +1,236 @@
+# benchmark.py
+#
+# Benchmark driver for the HiHiSpMV host: runs a matrix list over CU counts, partition methods and
+# test types (precisions), records the timings and rates the host prints into CSV/JSON and compares
+# them against a stored baseline. Runs on the card (hw), the emulators (sw_emu/hw_emu) or the CPU
+# simulation (csim, see "make build_xilinx_spmv_csim"), so host code regressions are caught anywhere.
+#
+# Example (CPU simulation, from the HiHiSpMV directory):
+#   python3 scripts/benchmark.py --backend csim --matrices scripts/benchmark_matrices.txt \
+#       --methods 2,4,5 --output bin/benchmark --baseline scripts/benchmark_baseline.json
+
+import argparse
+import csv
+import json
+import os
+import re
+import subprocess
+import sys
+
+# Metrics compared against the baseline, with True if lower is better
+METRICS = {
+    "parsing_matrix_time": True,
+    "xclbin_selection_time": True,
+    "partitioning_matrix_time": True,
+    "packing_time": True,
+    "sync_to_device_time": True,
+    "kernel_running_time": True,
+    "kernel_lowest_running time": True,
+    "readback_time": True,
+    "effective_GFLOPS": False,
+    "effective_bandwidth": False,
+    "useful_bandwidth": False,
+}
+
+# Further host outputs recorded as they are
+RECORDED = ["selected_xclbin", "computeUnits", "hwSideLen", "tilesInYPart", "partition_cost_max_streamed_bytes",
+    "partition_cost_imbalance", "partition_cost_padding_efficiency", "perf_model_max_cycles", "perf_model_imbalance",
+    "perf_model_predicted_kernel_time", "data_transfer_per_run_(MiB)", "useful_bytes_per_run", "streamed_bytes_per_run",
+    "wasted_bytes_per_run", "streamed_bandwidth", "hbm_peak_bandwidth", "roofline_useful", "roofline_streamed"]
+
+KEY_FIELDS = ["matrix", "compute_units", "part_method", "test_type"]
+
+BACKEND_HOSTS = {"hw": "bin/xilinx_spmv_host", "sw_emu": "bin/xilinx_spmv_host", "hw_emu": "bin/xilinx_spmv_host",
+    "csim": "bin/xilinx_spmv_csim"}
+
+
+def read_matrix_list(list_file, data_dir):
+    matrices = []
+    with open(list_file, 'r') as read:
+        for line in read:
+            line = line.split('#')[0].strip()
+            if not line:
+                continue
+            # Generated matrices (gen:..., see src/matrix_generator.hpp) and absolute paths are taken as they are
+            matrices.append(line if line.startswith("gen:") or os.path.isabs(line) else os.path.join(data_dir, line))
+    return matrices
+
+
+def parse_host_output(output):
+    values = {}
+    for line in output.splitlines():
+        match = re.match(r'^([^:\[\]]+): (.*)$', line.strip())
+        if match:
+            values[match.group(1).split(' (')[0].strip()] = match.group(2).strip()
+    values["valid"] = "Validation success" in output
+    return values
+
+
+def to_number(value):
+    try:
+        return float(value)
+    except (TypeError, ValueError):
+        return value
+
+
+def run_config(args, matrix, cus, method, test):
+    command = [args.host, args.xclbin, matrix, str(args.device), str(test), str(cus), "0", str(args.hw_size),
+        str(method), str(args.iterations), str(args.runs)]
+    env = dict(os.environ)
+    if args.backend in ("sw_emu", "hw_emu"):
+        env.update({"XCL_EMULATION_MODE": args.backend, "EMCONFIG_PATH": ".", "XRT_INI_PATH": "xrt.ini"})
+
+    record = {"matrix": matrix, "compute_units": cus, "part_method": method, "test_type": test, "backend": args.backend}
+    try:
+        result = subprocess.run(command, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+            universal_newlines=True, timeout=args.timeout)
+        values = parse_host_output(result.stdout)
+        record["exit_code"] = result.returncode
+    except subprocess.TimeoutExpired:
+        values = {"valid": False}
+        record["exit_code"] = "timeout"
+
+    record["valid"] = values["valid"] and record["exit_code"] == 0
+    for key in list(METRICS) + RECORDED:
+        record[key] = to_number(values.get(key))
+    # A valid run prints every key, a missing one is a renamed or dropped host output
+    record["missing_keys"] = [key for key in list(METRICS) + RECORDED if key not in values] if record["valid"] else []
+    for key in record["missing_keys"]:
+        print("WARNING", record_key(record), "host output has no key:", key)
+    return record
+
+
+def record_key(record):
+    return tuple(str(record[field]) for field in KEY_FIELDS)
+
+
+def compare_with_baseline(records, baseline_file, threshold):
+    with open(baseline_file, 'r') as read:
+        baseline = {record_key(record): record for record in json.load(read)}
+
+    regressions = 0
+    for record in records:
+        base = baseline.get(record_key(record))
+        if base is None:
+            print("baseline: no entry for", record_key(record))
+            continue
+        if base.get("valid") and not record["valid"]:
+            print("REGRESSION", record_key(record), "validation failed")
+            regressions += 1
+            continue
+        for metric, lower_better in METRICS.items():
+            new, old = record.get(metric), base.get(metric)
+            if not isinstance(new, float) or not isinstance(old, float) or old == 0:
+                continue
+            change = (new - old) / old * 100.0 * (1 if lower_better else -1) # Positive is worse
+            if change > threshold:
+                print("REGRESSION", record_key(record), metric, old, "->", new, "({:+.1f}% worse)".format(change))
+                regressions += 1
+    return regressions
+
+
+def calibrate_model(records, model_file):
+    # Fits kernel_running_time (µsec) = launch_usec + cycle_scale * perf_model_max_cycles / frequency_mhz
+    model = {"frequency_mhz": 225.0}
+    if os.path.exists(model_file):
+        with open(model_file, 'r') as read:
+            for line in read:
+                fields = line.split('#')[0].split()
+                if len(fields) == 2:
+                    model[fields[0]] = float(fields[1])
+
+    points = [(r["perf_model_max_cycles"] / model["frequency_mhz"], r["kernel_running_time"]) for r in records
+        if r["valid"] and isinstance(r["perf_model_max_cycles"], float) and isinstance(r["kernel_running_time"], float)]
+    if not points:
+        print("calibration: no valid runs")
+        return
+
+    n = len(points)
+    mean_x = sum(x for x, _ in points) / n
+    mean_y = sum(y for _, y in points) / n
+    var_x = sum((x - mean_x) ** 2 for x, _ in points)
+    if n > 1 and var_x > 0:
+        scale = sum((x - mean_x) * (y - mean_y) for x, y in points) / var_x
+        launch = mean_y - scale * mean_x
+    else: # A single point only fits the scale, with the given launch overhead
+        launch = model.get("launch_usec", 10.0)
+        scale = (mean_y - launch) / mean_x if mean_x else 1.0
+    model["cycle_scale"] = max(scale, 0.0)
+    model["launch_usec"] = max(launch, 0.0)
+
+    with open(model_file, 'w') as write:
+        write.write("# Fitted by scripts/benchmark.py from {0} runs\n".format(n))
+        for key, value in model.items():
+            write.write("{0} {1}\n".format(key, value))
+    print("calibration: written", model_file, model)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="HiHiSpMV benchmark driver")
+    parser.add_argument("--backend", choices=list(BACKEND_HOSTS), default="hw")
+    parser.add_argument("--host", help="host binary (default per backend)")
+    parser.add_argument("--xclbin", help="xclbin(s), comma-separated; the link config for csim",
+        default=None)
+    parser.add_argument("--matrices", required=True, help="matrix list file, one path (relative to --data) per line")
+    parser.add_argument("--data", default="data")
+    parser.add_argument("--device", type=int, default=0)
+    parser.add_argument("--cus", default="0", help="comma-separated CU counts, 0 = all in the xclbin")
+    parser.add_argument("--methods", default="2", help="comma-separated partition methods")
+    parser.add_argument("--tests", default="0", help="comma-separated test types, i.e. precisions (0 = single)")
+    parser.add_argument("--hw-size", type=int, default=0)
+    parser.add_argument("--iterations", type=int, default=100)
+    parser.add_argument("--runs", type=int, default=10)
+    parser.add_argument("--timeout", type=int, default=3600, help="per run (sec)")
+    parser.add_argument("--output", default="bin/benchmark", help="<output>.csv and <output>.json")
+    parser.add_argument("--baseline", help="baseline JSON to compare against, written if it does not exist")
+    parser.add_argument("--threshold", type=float, default=10.0, help="regression threshold (%%)")
+    parser.add_argument("--update-baseline", action="store_true", help="write the results as the baseline")
+    parser.add_argument("--calibrate", action="store_true", help="fit <xclbin>.model from the kernel times")
+    args = parser.parse_args(argv)
+
+    args.host = args.host or BACKEND_HOSTS[args.backend]
+    if args.xclbin is None:
+        args.xclbin = "src/kernels/single.1.cfg" if args.backend == "csim" else \
+            "bin/build_dir.{0}.1/hihi_spmv.xclbin".format(args.backend)
+
+    records = []
+    for matrix in read_matrix_list(args.matrices, args.data):
+        for cus in args.cus.split(','):
+            for method in args.methods.split(','):
+                for test in args.tests.split(','):
+                    record = run_config(args, matrix, int(cus), int(method), int(test))
+                    print("{0}, cus: {1}, method: {2}, test: {3}, valid: {4}, kernel_running_time (µsec): {5}, "
+                        "effective_GFLOPS: {6}".format(matrix, cus, method, test, record["valid"],
+                        record["kernel_running_time"], record["effective_GFLOPS"]))
+                    records.append(record)
+
+    os.makedirs(os.path.dirname(args.output) or ".", exist_ok=True)
+    with open(args.output + ".json", 'w') as write:
+        json.dump(records, write, indent=2)
+    with open(args.output + ".csv", 'w', newline='') as write:
+        writer = csv.DictWriter(write, fieldnames=list(records[0].keys()) if records else KEY_FIELDS)
+        writer.writeheader()
+        writer.writerows(records)
+    print("results:", args.output + ".csv", args.output + ".json")
+
+    if args.calibrate:
+        for xclbin in set(record["selected_xclbin"] or args.xclbin for record in records):
+            calibrate_model([r for r in records if (r["selected_xclbin"] or args.xclbin) == xclbin], xclbin + ".model")
+
+    status = 0
+    if args.baseline and not args.update_baseline and os.path.exists(args.baseline):
+        regressions = compare_with_baseline(records, args.baseline, args.threshold)
+        print("regressions:", regressions)
+        status = 1 if regressions else 0
+    elif args.baseline:
+        with open(args.baseline, 'w') as write:
+            json.dump(records, write, indent=2)
+        print("baseline: written", args.baseline)
+
+    if not all(record["valid"] and not record["missing_keys"] for record in records):
+        status = 1
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
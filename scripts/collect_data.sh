@@ -6,6 +6,17 @@ declare -A matrices
 
 matrices[psmigr_2]="https://suitesparse-collection-website.herokuapp.com/MM/HB/psmigr_2.tar.gz"                         #| n = 3.1k           | nnz =.54m  | unsymm
 
+# Curated set for scripts/benchmark.py (see scripts/benchmark_matrices.txt), downloaded by "collect_data.sh benchmark".
+# Unsymmetric with at most 30k rows, i.e. 16 CUs of the 1875 wide tiles.
+if [[ "$1" == "benchmark" ]]; then
+matrices[rdist1]="https://suitesparse-collection-website.herokuapp.com/MM/Zitney/rdist1.tar.gz"                      #| n = 4.1k           | nnz =.09m  | unsymm
+matrices[goodwin]="https://suitesparse-collection-website.herokuapp.com/MM/Goodwin/goodwin.tar.gz"                   #| n = 7.3k           | nnz =.32m  | unsymm
+matrices[lhr10]="https://suitesparse-collection-website.herokuapp.com/MM/Mallya/lhr10.tar.gz"                        #| n = 10.7k          | nnz =.23m  | unsymm
+matrices[ex11]="https://suitesparse-collection-website.herokuapp.com/MM/FIDAP/ex11.tar.gz"                           #| n = 16.6k          | nnz =1.1m  | unsymm
+matrices[raefsky3]="https://suitesparse-collection-website.herokuapp.com/MM/Simon/raefsky3.tar.gz"                   #| n = 21.2k          | nnz =1.5m  | unsymm
+matrices[af23560]="https://suitesparse-collection-website.herokuapp.com/MM/Bai/af23560.tar.gz"                       #| n = 23.6k          | nnz =.48m  | unsymm
+fi
+
 download_extract_matrix() {
     if ! wget "$2"; then
         echo "ERROR: can't download: $2" >&2
@@ -0,0 +1,14 @@
+/*
+    Host-only stand-in for the Vitis HLS AXI-stream side-channel packet.
+    Only the data payload and the last flag are modelled.
+*/
+
+#pragma once
+
+#include "ap_int.h"
+
+template<int D, int U, int TI, int TD>
+struct ap_axiu {
+    ap_uint<D> data;
+    ap_uint<1> last;
+};
@@ -0,0 +1,127 @@
+/*
+    Host-only stand-in for the Vitis HLS arbitrary precision unsigned integer.
+    Only the subset used by the kernels is provided: construction from integers,
+    bit-range read/write, single bit test, shifts and bitwise and.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+template<int W> class ap_uint;
+
+template<int W>
+class ap_range_ref {
+    public:
+        ap_range_ref(ap_uint<W> *ref, int hi, int lo): ref_(ref), hi_(hi), lo_(lo) { }
+
+        operator uint64_t() const { return ref_->get_range(hi_, lo_); }
+
+        ap_range_ref& operator=(uint64_t value) {
+            ref_->set_range(hi_, lo_, value);
+            return *this;
+        }
+
+        template<int W2>
+        ap_range_ref& operator=(const ap_uint<W2> &value) {
+            ref_->set_range(hi_, lo_, value.to_uint64());
+            return *this;
+        }
+
+        ap_range_ref& operator=(const ap_range_ref &other) {
+            ref_->set_range(hi_, lo_, (uint64_t) other);
+            return *this;
+        }
+
+    private:
+        ap_uint<W> *ref_;
+        int hi_, lo_;
+};
+
+template<int W>
+class ap_uint {
+    static constexpr int WORDS = (W+63)/64;
+
+    public:
+        uint64_t words[WORDS];
+
+        ap_uint() { clear(); }
+
+        template<typename I, typename std::enable_if<std::is_integral<I>::value, int>::type = 0>
+        ap_uint(I value) {
+            clear();
+            words[0] = (uint64_t) value;
+            trim();
+        }
+
+        template<int W2>
+        ap_uint(const ap_uint<W2> &other) {
+            clear();
+            for (int i=0; i<WORDS && i<(W2+63)/64; i++) words[i] = other.words[i];
+            trim();
+        }
+
+        template<int W2>
+        ap_uint(const ap_range_ref<W2> &ref) {
+            clear();
+            words[0] = (uint64_t) ref;
+            trim();
+        }
+
+        operator uint64_t() const { return to_uint64(); }
+
+        uint64_t to_uint64() const { return words[0]; }
+
+        ap_range_ref<W> range(int hi, int lo) const {
+            return ap_range_ref<W>(const_cast<ap_uint<W>*>(this), hi, lo);
+        }
+
+        bool test(int bit) const { return (words[bit/64] >> (bit%64)) & 1; }
+
+        uint64_t get_range(int hi, int lo) const {
+            uint64_t value = 0;
+            for (int i=hi; i>=lo; i--) value = (value << 1) | test(i);
+            return value;
+        }
+
+        void set_range(int hi, int lo, uint64_t value) {
+            for (int i=lo; i<=hi; i++, value >>= 1) {
+                uint64_t mask = 1ull << (i%64);
+                words[i/64] = (value & 1) ? (words[i/64] | mask) : (words[i/64] & ~mask);
+            }
+        }
+
+        template<typename I>
+        ap_uint operator>>(I shift) const {
+            ap_uint res;
+            for (int i=0; i+(int)shift<W; i++) if (test(i+shift)) res.set_range(i, i, 1);
+            return res;
+        }
+
+        template<typename I>
+        ap_uint operator<<(I shift) const {
+            ap_uint res;
+            for (int i=(int)shift; i<W; i++) if (test(i-shift)) res.set_range(i, i, 1);
+            return res;
+        }
+
+        ap_uint operator&(const ap_uint &other) const {
+            ap_uint res;
+            for (int i=0; i<WORDS; i++) res.words[i] = words[i] & other.words[i];
+            return res;
+        }
+
+        ap_uint operator|(const ap_uint &other) const {
+            ap_uint res;
+            for (int i=0; i<WORDS; i++) res.words[i] = words[i] | other.words[i];
+            return res;
+        }
+
+    private:
+        void clear() { for (int i=0; i<WORDS; i++) words[i] = 0; }
+
+        void trim() {
+            if (W%64) words[WORDS-1] &= (1ull << (W%64)) - 1;
+        }
+};
@@ -0,0 +1,21 @@
+/*
+    Host-only stand-in for the Vitis HLS shift register.
+*/
+
+#pragma once
+
+template<typename T, unsigned int N>
+class ap_shift_reg {
+    public:
+        T shift(T in, unsigned int addr = N-1) {
+            T out = regs_[addr];
+            for (unsigned int i=N-1; i>0; i--) regs_[i] = regs_[i-1];
+            regs_[0] = in;
+            return out;
+        }
+
+        T read(unsigned int addr = N-1) const { return regs_[addr]; }
+
+    private:
+        T regs_[N] = {};
+};
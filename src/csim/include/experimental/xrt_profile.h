@@ -0,0 +1,3 @@
+// Host-only stand-in, see xrt_csim.hpp
+#pragma once
+#include "../xrt_csim.hpp"
@@ -0,0 +1,72 @@
+/*
+    Host-only stand-in for the Vitis HLS stream.
+    An unbounded, thread-safe FIFO: read() blocks until data is available, which
+    lets the kernels of one CU run as concurrent threads like in sw_emu.
+*/
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace hls {
+
+template<typename T>
+class stream {
+    public:
+        stream() { }
+        stream(const char *name) { }
+        stream(const stream&) = delete;
+        stream& operator=(const stream&) = delete;
+
+        void write(const T &value) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                fifo_.push_back(value);
+            }
+            cond_.notify_one();
+        }
+
+        T read() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this]{ return !fifo_.empty(); });
+            T value = fifo_.front();
+            fifo_.pop_front();
+            return value;
+        }
+
+        void read(T &value) { value = read(); }
+
+        bool read_nb(T &value) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (fifo_.empty()) return false;
+            value = fifo_.front();
+            fifo_.pop_front();
+            return true;
+        }
+
+        bool write_nb(const T &value) {
+            write(value);
+            return true;
+        }
+
+        bool empty() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return fifo_.empty();
+        }
+
+        bool full() const { return false; }
+
+        unsigned int size() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return fifo_.size();
+        }
+
+    private:
+        std::deque<T> fifo_;
+        mutable std::mutex mutex_;
+        std::condition_variable cond_;
+};
+
+}
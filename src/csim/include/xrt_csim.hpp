@@ -0,0 +1,156 @@
+/*
+    Host-only stand-in for the subset of the XRT native API used by the host.
+    Built with the host and the kernels by "make build_xilinx_spmv_csim".
+
+    Buffers live in host memory, kernels are the HLS sources compiled for the host
+    and every xrt::run executes its kernel in a thread. The "xclbin" handed to the
+    device is the Vitis link configuration (e.g. src/kernels/single.1.cfg): its
+    nk= lines define the CUs and its sc= lines define the kernel-to-kernel FIFOs.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <map>
+
+enum xclBOSyncDirection {
+    XCL_BO_SYNC_BO_TO_DEVICE = 0,
+    XCL_BO_SYNC_BO_FROM_DEVICE,
+};
+
+namespace xrt {
+
+class uuid { };
+
+class device {
+    public:
+        device() { }
+        explicit device(unsigned int index) { }
+        uuid load_xclbin(const std::string &xclbinFile);
+};
+
+class bo {
+    public:
+        enum class flags : uint32_t { normal = 0, cacheable = 1 << 24, device_only = 1 << 28, host_only = 1 << 29 };
+
+        bo() { }
+        bo(const device &dev, size_t bytes, flags flag, int group): 
+            storage_(std::make_shared<std::vector<uint64_t>>((bytes+7)/8)), bytes_(bytes) { }
+
+        template<typename T> T map() { return reinterpret_cast<T>(storage_->data()); }
+        void sync(xclBOSyncDirection dir) { }
+        void sync(xclBOSyncDirection dir, size_t bytes, size_t offset) { }
+        size_t size() const { return bytes_; }
+
+    private:
+        std::shared_ptr<std::vector<uint64_t>> storage_;
+        size_t bytes_ = 0;
+};
+
+class kernel {
+    public:
+        kernel() { }
+        kernel(const device &dev, const uuid &id, const std::string &name, bool exclusive = false);
+
+        int group_id(int argIndex) const { return argIndex; }
+        const std::string& get_name() const { return name_; }
+        const std::string& get_cu_name() const { return cuName_; }
+
+    private:
+        std::string name_, cuName_;
+};
+
+struct csim_arg {
+    bool isBo = false;
+    bo buffer;
+    uint64_t scalar = 0;
+};
+
+class run {
+    public:
+        run() { }
+        explicit run(const kernel &krnl): state_(std::make_shared<state>()) { state_->krnl = krnl; }
+
+        void set_arg(int index, bo &buffer) { arg(index).isBo = true; arg(index).buffer = buffer; }
+        void set_arg(int index, const bo &buffer) { arg(index).isBo = true; arg(index).buffer = buffer; }
+
+        template<typename S>
+        void set_arg(int index, S value) { arg(index).scalar = (uint64_t) value; }
+
+        void start();
+        void wait();
+
+    private:
+        struct state {
+            kernel krnl;
+            std::vector<csim_arg> args;
+            std::thread worker;
+        };
+
+        csim_arg& arg(int index) {
+            if (state_->args.size() <= index) state_->args.resize(index+1);
+            return state_->args[index];
+        }
+
+        std::shared_ptr<state> state_;
+};
+
+class xclbin {
+    public:
+        class mem {
+            public:
+                mem(const std::string &tag, int index): tag_(tag), index_(index) { }
+                int get_type() const { return 0; }
+                std::string get_tag() const { return tag_; }
+                bool get_used() const { return true; }
+                int get_index() const { return index_; }
+            private:
+                std::string tag_;
+                int index_;
+        };
+
+        class arg {
+            public:
+                arg(const std::string &port): port_(port) { }
+                std::string get_port() const { return port_; }
+                std::string get_host_type() const { return "csim"; }
+                std::vector<mem> get_mems() const { return {}; }
+            private:
+                std::string port_;
+        };
+
+        class ip {
+            public:
+                ip(const std::string &name): name_(name) { }
+                std::string get_name() const { return name_; }
+                std::vector<arg> get_args() const { return {}; }
+            private:
+                std::string name_;
+        };
+
+        class kernel {
+            public:
+                kernel(const std::string &name): name_(name) { }
+                std::string get_name() const { return name_; }
+                std::vector<ip> get_cus() const { return cus_; }
+                void add_cu(const std::string &name) { cus_.emplace_back(name); }
+            private:
+                std::string name_;
+                std::vector<ip> cus_;
+        };
+
+        xclbin() { }
+        explicit xclbin(const std::string &xclbinFile);
+
+        std::vector<kernel> get_kernels() const { return kernels_; }
+        std::vector<mem> get_mems() const { return {}; }
+
+    private:
+        std::vector<kernel> kernels_;
+};
+
+}
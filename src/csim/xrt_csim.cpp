@@ -0,0 +1,187 @@
+/*
+    CPU simulation backend: XRT stand-in implementation and kernel launchers.
+
+    Every CU of the link configuration gets its kernel-to-kernel FIFOs from the
+    sc= lines, so the four kernels of a CU exchange data exactly as on the card.
+*/
+
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+
+#include <xlx_definitions.hpp>
+#include "xrt_csim.hpp"
+
+extern "C" {
+    void csr_spmv_repl_1(hls::stream<pkt_block>& out_indices, hls::stream<pkt_block>& out_values,
+        hls::stream<pkt_block>& out_vector, hls::stream<pkt_block>& in_y, valb_t* values, const intb_t* indices,
+        const valb_t* vectors,
+        const unsigned int x_blocks_tot, const unsigned int row_blocks_tot, const unsigned int y_blocks,
+        const unsigned int nnz_blocks_tot, const unsigned int col_blocks_tot, const unsigned int tile_blocks,
+        const unsigned int runs);
+    void csr_spmv_repl_2(hls::stream<pkt_ind_nnz>& out_row_tupples, hls::stream<pkt_block>& out_prod,
+        hls::stream<pkt_block>& in_indices, hls::stream<pkt_block>& in_values,
+        hls::stream<pkt_block>& in_vector, const unsigned int x_blocks,
+        const unsigned int tiles, const unsigned int prod_blocks_tot, const unsigned int runs);
+    void csr_spmv_repl_3(hls::stream<pkt_ind_val> &out_rows, hls::stream<pkt_ind_nnz> &in_row_tupples,
+        hls::stream<pkt_block> &in_prod, const unsigned int tiles, const unsigned int nnz_blocks_tot,
+        const unsigned int runs);
+    void csr_spmv_repl_4(hls::stream<pkt_block> &out_y, hls::stream<pkt_ind_val> &in_rows,
+        const unsigned int y_blocks, const unsigned int tiles, const unsigned int runs);
+    void csr_spmv_caps(intb_t* caps);
+}
+
+namespace {
+
+struct Channel {
+    std::shared_ptr<void> fifo;
+};
+
+struct LinkConfig {
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<Channel>> ports; // "<cu>.<port>" -> channel
+    std::vector<std::pair<std::string, int>> kernels; // nk=<kernel>:<count>
+};
+
+LinkConfig& Link() {
+    static LinkConfig link;
+    return link;
+}
+
+void ParseLinkConfig(const std::string &cfgFile, LinkConfig &link) {
+    std::ifstream file(cfgFile);
+    if (!file.good()) {
+        std::cout << "csim: can not read the link config: " << cfgFile << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::lock_guard<std::mutex> lock(link.mutex);
+    link.ports.clear();
+    link.kernels.clear();
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
+        if (line.compare(0, 3, "sc=") == 0) { // sc=<cu>.<port>:<cu>.<port>[:<depth>]
+            std::stringstream ss(line.substr(3));
+            std::string src, dst;
+            std::getline(ss, src, ':');
+            std::getline(ss, dst, ':');
+            auto channel = std::make_shared<Channel>();
+            link.ports[src] = channel;
+            link.ports[dst] = channel;
+        } else if (line.compare(0, 3, "nk=") == 0) { // nk=<kernel>:<count>
+            auto sep = line.find(':');
+            link.kernels.emplace_back(line.substr(3, sep-3), std::stoi(line.substr(sep+1)));
+        }
+    }
+}
+
+template<typename T>
+hls::stream<T>& Port(const std::string &cuName, const std::string &port) {
+    auto &link = Link();
+    std::lock_guard<std::mutex> lock(link.mutex);
+    auto found = link.ports.find(cuName + "." + port);
+    if (found == link.ports.end()) {
+        std::cout << "csim: " << cuName << "." << port << " is not connected (sc=) in the link config" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    auto &channel = found->second;
+    if (!channel->fifo) {
+        channel->fifo = std::make_shared<hls::stream<T>>();
+    }
+    return *std::static_pointer_cast<hls::stream<T>>(channel->fifo);
+}
+
+template<typename P>
+P* Pointer(xrt::csim_arg &arg) {
+    return arg.buffer.map<P*>();
+}
+
+unsigned int Scalar(xrt::csim_arg &arg) {
+    return (unsigned int) arg.scalar;
+}
+
+using Launcher = std::function<void(const std::string&, std::vector<xrt::csim_arg>&)>;
+
+const std::map<std::string, Launcher>& Launchers() {
+    static const std::map<std::string, Launcher> launchers = {
+        {"csr_spmv_repl_1", [](const std::string &cu, std::vector<xrt::csim_arg> &a) {
+            a.resize(14);
+            csr_spmv_repl_1(Port<pkt_block>(cu, "out_indices"), Port<pkt_block>(cu, "out_values"),
+                Port<pkt_block>(cu, "out_vector"), Port<pkt_block>(cu, "in_y"), Pointer<valb_t>(a[4]),
+                Pointer<intb_t>(a[5]), Pointer<valb_t>(a[6]),
+                Scalar(a[7]), Scalar(a[8]), Scalar(a[9]), Scalar(a[10]), Scalar(a[11]), Scalar(a[12]), Scalar(a[13]));
+        }},
+        {"csr_spmv_repl_2", [](const std::string &cu, std::vector<xrt::csim_arg> &a) {
+            a.resize(9);
+            csr_spmv_repl_2(Port<pkt_ind_nnz>(cu, "out_row_tupples"), Port<pkt_block>(cu, "out_prod"),
+                Port<pkt_block>(cu, "in_indices"), Port<pkt_block>(cu, "in_values"), Port<pkt_block>(cu, "in_vector"),
+                Scalar(a[5]), Scalar(a[6]), Scalar(a[7]), Scalar(a[8]));
+        }},
+        {"csr_spmv_repl_3", [](const std::string &cu, std::vector<xrt::csim_arg> &a) {
+            a.resize(6);
+            csr_spmv_repl_3(Port<pkt_ind_val>(cu, "out_rows"), Port<pkt_ind_nnz>(cu, "in_row_tupples"),
+                Port<pkt_block>(cu, "in_prod"), Scalar(a[3]), Scalar(a[4]), Scalar(a[5]));
+        }},
+        {"csr_spmv_repl_4", [](const std::string &cu, std::vector<xrt::csim_arg> &a) {
+            a.resize(5);
+            csr_spmv_repl_4(Port<pkt_block>(cu, "out_y"), Port<pkt_ind_val>(cu, "in_rows"),
+                Scalar(a[2]), Scalar(a[3]), Scalar(a[4]));
+        }},
+        {"csr_spmv_caps", [](const std::string &cu, std::vector<xrt::csim_arg> &a) {
+            a.resize(1);
+            csr_spmv_caps(Pointer<intb_t>(a[0]));
+        }},
+    };
+    return launchers;
+}
+
+}
+
+namespace xrt {
+
+uuid device::load_xclbin(const std::string &xclbinFile) {
+    ParseLinkConfig(xclbinFile, Link());
+    return uuid();
+}
+
+kernel::kernel(const device &dev, const uuid &id, const std::string &name, bool exclusive) {
+    // "<kernel>:{<cu>}"
+    auto sep = name.find(":{");
+    name_ = name.substr(0, sep);
+    cuName_ = sep == std::string::npos ? name_ + "_1" : name.substr(sep+2, name.size()-sep-3);
+    if (Launchers().find(name_) == Launchers().end()) {
+        std::cout << "csim: no launcher for the kernel: " << name_ << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void run::start() {
+    auto st = state_;
+    st->worker = std::thread([st]() {
+        Launchers().at(st->krnl.get_name())(st->krnl.get_cu_name(), st->args);
+    });
+}
+
+void run::wait() {
+    if (state_->worker.joinable()) {
+        state_->worker.join();
+    }
+}
+
+xclbin::xclbin(const std::string &xclbinFile) {
+    LinkConfig link;
+    ParseLinkConfig(xclbinFile, link);
+    for (auto &entry : link.kernels) {
+        kernel krnl(entry.first);
+        for (int i=1; i<=entry.second; i++) {
+            krnl.add_cu(entry.first + "_" + std::to_string(i));
+        }
+        kernels_.push_back(krnl);
+    }
+}
+
+}
@@ -0,0 +1,35 @@
+#include <xlx_definitions.hpp>
+
+/*
+    Capacity query kernel, one CU per xclbin. Writes the compile-time limits 
+    of the SpMV kernels it is linked with into a single block.
+*/
+
+extern "C" {
+
+    void csr_spmv_caps(intb_t* caps) {
+
+        #pragma HLS INTERFACE m_axi port=caps offset=slave bundle=gmem0 max_write_burst_length=16
+
+        intb_t caps_block;
+        for (unsigned int i=0; i<BLOCK_SIZE; i++) { // Auto unrolled
+            #pragma HLS UNROLL
+            caps_block.items[i] = 0;
+        }
+
+        caps_block.items[CAPS_MAGIC_INDEX] = CAPS_MAGIC;
+        caps_block.items[CAPS_VECTOR_SIZE_INDEX] = VECTOR_SIZE;
+        caps_block.items[CAPS_BLOCK_SIZE_INDEX] = BLOCK_SIZE;
+        caps_block.items[CAPS_MAX_TILES_INDEX] = MAX_TILES;
+        caps_block.items[CAPS_PREC_SIZE_INDEX] = PREC_SIZE;
+        caps_block.items[CAPS_URAM_INDEX] = URAM;
+        caps_block.items[CAPS_PERF_COUNTERS_INDEX] = PERF_COUNTERS;
+        caps_block.items[CAPS_TILE_FORMATS_INDEX] = TILE_FORMATS;
+
+#if DEBUG 
+        if (DEBUG&1) printf ("caps::vector_size: %d, block_size: %d, prec_size: %d\n", 
+            (int) VECTOR_SIZE, (int) BLOCK_SIZE, (int) PREC_SIZE);
+#endif
+        caps[0] = caps_block;
+    }
+}
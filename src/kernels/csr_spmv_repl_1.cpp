@@ -10,17 +10,20 @@
 
 void read_indices(
         hls::stream<pkt_block> &out_indices,
+        hls::stream<indvec_k2k_t> &out_perf,
         const intb_t* indices,
         const unsigned int ind_end_1,
         const unsigned int ind_end_2,
+        const unsigned int ind_end_3,
         const unsigned int runs) {
     
-    unsigned int ind_end = ind_end_1 + ind_end_2 + 1; // +1: nnzs in each block
+    unsigned int ind_end = ind_end_1 + ind_end_2 + ind_end_3; // + tile descriptor blocks
     // XRT 2.15 i.e 2023.1: Pragma conflict happens on 'INLINE' and DATAFLOW pragmas: Inline into dataflow region may break the canonical form.
     #pragma HLS INLINE
 #if DEBUG 
     if (DEBUG&1) printf ("k1::read_indices(): start\n");
 #endif
+    unsigned int active = 0, out_stall = 0; // See PERF_*
     assert(runs>0); // Helps inferring the compiler that the loop must be entered at least
     for (unsigned int h=0; h<runs; h++)  {
         #pragma HLS PIPELINE OFF
@@ -29,6 +32,8 @@ void read_indices(
         for (unsigned int i=0; i<ind_end; i++) {
             #pragma HLS PIPELINE II=1
             #pragma HLS loop_tripcount min=(rows_blk_min+nnz_blk_min) max=(rows_blk_max+nnz_blk_max)
+            active++;
+            out_stall += out_indices.full();
             intb_t ind_block = indices[i];
             indvec_k2k_t ind_buff; // TODO: Combine the structs
 #if DEBUG 
@@ -49,6 +54,11 @@ void read_indices(
             out_indices.write(v);
         }
     }
+#if PERF_COUNTERS
+    indvec_k2k_t perf;
+    perf_block(perf, 1, active, 0, out_stall, active, 0);
+    out_perf.write(perf);
+#endif
     
 #if DEBUG 
     if (DEBUG&1) printf ("k1::read_indices(): end\n");
@@ -57,17 +67,18 @@ void read_indices(
 
 void read_values(
         hls::stream<pkt_block> &out_values,
+        hls::stream<indvec_k2k_t> &out_perf,
         const valb_t* values,
-        const unsigned int vals_end_1,
-        const unsigned int vals_end_2,
+        const unsigned int vals_start,
+        const unsigned int vals_end,
         const unsigned int runs) {
     
-    unsigned int vals_end = vals_end_1 + vals_end_2;
 
     #pragma HLS INLINE
 #if DEBUG 
     if (DEBUG&1) printf ("k1::read_values(): start\n");
 #endif
+    unsigned int active = 0, out_stall = 0; // See PERF_*
     assert(runs>0); // Helps inferring the compiler that the loop must be entered at least
     for (unsigned int h=0; h<runs; h++) {
         #pragma HLS PIPELINE OFF
@@ -75,8 +86,10 @@ void read_values(
         assert(vals_end>0); // Helps inferring the compiler that the loop must be entered at least
         for (unsigned int i=0; i<vals_end; i++) {
             #pragma HLS PIPELINE II=1
-            #pragma HLS loop_tripcount min=(vec_blk_min+nnz_blk_min) max=(vec_blk_max+nnz_blk_max)
-            valb_t val_block = values[i];
+            #pragma HLS loop_tripcount min=(nnz_blk_min) max=(nnz_blk_max)
+            active++;
+            out_stall += out_values.full();
+            valb_t val_block = values[vals_start+i];
             valvec_k2k_t vals_buff; // TODO: Combine the structs
 #if DEBUG 
             if (DEBUG&2) printf ("k1::value-block: %d\n", i);
@@ -96,14 +109,69 @@ void read_values(
             out_values.write(v);
         }
     }
+#if PERF_COUNTERS
+    indvec_k2k_t perf;
+    perf_block(perf, 1, active, 0, out_stall, active, 0);
+    out_perf.write(perf);
+#endif
     
 #if DEBUG 
     if (DEBUG&1) printf ("k1::read_values(): end\n");
 #endif
 }
 
+void read_vector(
+        hls::stream<pkt_block> &out_vector,
+        hls::stream<indvec_k2k_t> &out_perf,
+        const valb_t* vectors,
+        const unsigned int vec_end,
+        const unsigned int runs) {
+    
+    #pragma HLS INLINE
+#if DEBUG 
+    if (DEBUG&1) printf ("k1::read_vector(): start\n");
+#endif
+    unsigned int active = 0, out_stall = 0; // See PERF_*
+    assert(runs>0); // Helps inferring the compiler that the loop must be entered at least
+    for (unsigned int h=0; h<runs; h++) {
+        #pragma HLS PIPELINE OFF
+        
+        assert(vec_end>0); // Helps inferring the compiler that the loop must be entered at least
+        for (unsigned int i=0; i<vec_end; i++) {
+            #pragma HLS PIPELINE II=1
+            #pragma HLS loop_tripcount min=(vec_blk_min) max=(vec_blk_max)
+            active++;
+            out_stall += out_vector.full();
+            valb_t vec_block = vectors[i];
+            valvec_k2k_t vec_buff;
+#if DEBUG 
+            if (DEBUG&2) printf ("k1::vector-block: %d\n", i);
+#endif
+            for (unsigned int j=0; j<BLOCK_SIZE; j++) { // Auto unrolled
+                #pragma HLS UNROLL
+                vec_buff.items[j] = vec_block.items[j];
+            }
+            pkt_block v;
+            vec_buff.set(v.data);
+            out_vector.write(v);
+        }
+    }
+#if PERF_COUNTERS
+    indvec_k2k_t perf;
+    perf_block(perf, 1, active, 0, out_stall, active, 0);
+    out_perf.write(perf);
+#endif
+    
+#if DEBUG 
+    if (DEBUG&1) printf ("k1::read_vector(): end\n");
+#endif
+}
+
 void write_results(
         hls::stream<pkt_block>& res_stream,
+        hls::stream<indvec_k2k_t>& in_perf_indices,
+        hls::stream<indvec_k2k_t>& in_perf_values,
+        hls::stream<indvec_k2k_t>& in_perf_vector,
         valb_t* vec_res,
         // prec_t* result,
         const unsigned int write_start_1,
@@ -144,6 +212,41 @@ void write_results(
         vec_res[write_start+i] = res_buffer;
     }
 
+#if PERF_COUNTERS
+    // The readers make up this kernel's block: the busiest one's trips, all stalls and blocks
+    indvec_k2k_t perf = in_perf_indices.read();
+    indvec_k2k_t perf_reader[2] = {in_perf_values.read(), in_perf_vector.read()};
+    for (unsigned int k=0; k<2; k++) {
+        perf.items[PERF_ACTIVE_INDEX] = perf_reader[k].items[PERF_ACTIVE_INDEX] > perf.items[PERF_ACTIVE_INDEX] ? 
+            perf_reader[k].items[PERF_ACTIVE_INDEX] : perf.items[PERF_ACTIVE_INDEX];
+        perf.items[PERF_OUT_STALL_INDEX] += perf_reader[k].items[PERF_OUT_STALL_INDEX];
+        perf.items[PERF_BLOCKS_INDEX] += perf_reader[k].items[PERF_BLOCKS_INDEX];
+    }
+
+    perf_write: // Behind the y partition: this kernel's block, then k2's, k3's and k4's as relayed by k4
+    for (unsigned int i=0; i<PERF_BLOCKS; i++) {
+        #pragma HLS PIPELINE II=1
+        indvec_k2k_t block;
+        if (i == 0) {
+            block = perf;
+        } else {
+            pkt_block v = res_stream.read();
+            block.get(v.data);
+        }
+        valb_t perf_buffer;
+        for (unsigned int j=0; j<BLOCK_SIZE; j++) {
+            #pragma HLS UNROLL
+            union {
+                int val_int;
+                prec_t val_fp;
+            } intfp_t;
+            intfp_t.val_int = block.items[j];
+            perf_buffer.items[j] = intfp_t.val_fp;
+        }
+        vec_res[write_start+write_blocks+i] = perf_buffer;
+    }
+#endif
+
 #if DEBUG 
     if (DEBUG&1) printf ("k1::write_results(): end\n");
 #endif
@@ -154,28 +257,36 @@ extern "C" {
     void csr_spmv_repl_1(
             hls::stream<pkt_block>& out_indices,
             hls::stream<pkt_block>& out_values,
+            hls::stream<pkt_block>& out_vector,
             hls::stream<pkt_block>& in_y,
             valb_t* values, 
             const intb_t* indices,
+            const valb_t* vectors, // Same buffer as values, the x segments in front of the nnz values
             // /*prec_t*/ valb_t* result,
             const unsigned int x_blocks_tot,
             const unsigned int row_blocks_tot, 
             const unsigned int y_blocks, 
             const unsigned int nnz_blocks_tot,
+            const unsigned int col_blocks_tot, // nnz blocks of the CSR and SELL tiles, a block per BLOCK_SIZE of BCSR's
+            const unsigned int tile_blocks,
             const unsigned int runs) {
 
         #pragma HLS INTERFACE m_axi port=values offset=slave bundle=gmem0 max_read_burst_length=16 max_write_burst_length=16
         #pragma HLS INTERFACE m_axi port=indices offset=slave bundle=gmem1 max_read_burst_length=16 
+        #pragma HLS INTERFACE m_axi port=vectors offset=slave bundle=gmem2 max_read_burst_length=16 
         // // #pragma HLS INTERFACE m_axi port=result offset=slave bundle=gmem2 max_write_burst_length=16
 
         #pragma HLS INTERFACE axis port = out_indices
         #pragma HLS INTERFACE axis port = out_values
+        #pragma HLS INTERFACE axis port = out_vector
         #pragma HLS INTERFACE axis port = in_y
 
         #pragma HLS INTERFACE s_axilite port = x_blocks_tot
         #pragma HLS INTERFACE s_axilite port = row_blocks_tot
         #pragma HLS INTERFACE s_axilite port = y_blocks
         #pragma HLS INTERFACE s_axilite port = nnz_blocks_tot
+        #pragma HLS INTERFACE s_axilite port = col_blocks_tot
+        #pragma HLS INTERFACE s_axilite port = tile_blocks
         #pragma HLS INTERFACE s_axilite port = runs
 
         // #pragma HLS INTERFACE s_axilite port = result
@@ -185,11 +296,19 @@ extern "C" {
         if (DEBUG&1) printf ("k1::row_blocks_tot: %d\n", row_blocks_tot);
         if (DEBUG&1) printf ("k1::y_blocks: %d\n", y_blocks);
         if (DEBUG&1) printf ("k1::nnz_blocks_tot: %d\n", nnz_blocks_tot);
+        if (DEBUG&1) printf ("k1::col_blocks_tot: %d\n", col_blocks_tot);
+        if (DEBUG&1) printf ("k1::tile_blocks: %d\n", tile_blocks);
 #endif
+        static hls::stream<indvec_k2k_t> perf_indices, perf_values, perf_vector; // Reader counters, see PERF_*
+        #pragma HLS STREAM variable=perf_indices depth=2
+        #pragma HLS STREAM variable=perf_values depth=2
+        #pragma HLS STREAM variable=perf_vector depth=2
+
         #pragma HLS DATAFLOW
 
-        read_indices(out_indices, indices, row_blocks_tot, nnz_blocks_tot, runs); 
-        read_values(out_values, values, x_blocks_tot, nnz_blocks_tot, runs);
-        write_results(in_y, values /*result*/, x_blocks_tot, nnz_blocks_tot, y_blocks, runs);
+        read_indices(out_indices, perf_indices, indices, row_blocks_tot, col_blocks_tot, tile_blocks, runs); 
+        read_values(out_values, perf_values, values, x_blocks_tot, nnz_blocks_tot, runs);
+        read_vector(out_vector, perf_vector, vectors, x_blocks_tot, runs);
+        write_results(in_y, perf_indices, perf_values, perf_vector, values /*result*/, x_blocks_tot, nnz_blocks_tot, y_blocks, runs);
     }
 }
\ No newline at end of file
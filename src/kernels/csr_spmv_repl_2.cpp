@@ -11,8 +11,6 @@
 void read_rows(
         hls::stream<pkt_ind_nnz> &out_row_tupple,
         hls::stream<indvec_k2k_t> &in_rows_str,
-        const unsigned int y_len,
-        const unsigned int row_blocks,
         const unsigned int tiles,
         const unsigned int runs) {
 #if DEBUG 
@@ -21,9 +19,6 @@ void read_rows(
     // XRT 2.15 i.e 2023.1: Pragma conflict happens on 'INLINE' and DATAFLOW pragmas: Inline into dataflow region may break the canonical form.
     // #pragma HLS INLINE
 
-    int row_ptr[VECTOR_SIZE+BLOCK_SIZE];
-    #pragma HLS ARRAY_PARTITION variable=row_ptr type=cyclic factor=8
-
     assert(runs>0);
     runs:
     for (unsigned int h=0; h<runs; h++) {
@@ -38,52 +33,46 @@ void read_rows(
 #if DEBUG
             if (DEBUG&1) printf ("k2::read_rows(): start of tile: %d\n", tile);
 #endif
-            // int row_blocks = row_blocks_vec[tile];
-            // int y_len = y_len_vec[tile];
-
-            indvec_k2k_t old_row_buffer; // 0 init
+            indvec_k2k_t row_buffer;
+            #pragma HLS array_partition variable=row_buffer.items complete dim=0
 
-            row_read:
-            for (unsigned int i=0; i<row_blocks; i++) { // The possible trailing buffer is also read
+            bool tile_end = false;
+            unsigned int entry_ind = 0, lane = 0;
+            int row_entry = ROW_ENTRY_END;
+            row_write: 
+            for (; !tile_end;) { // Decodes a row entry, or a row of a slice, per cycle up to the end entry
                 #pragma HLS PIPELINE II=1
-                #pragma HLS loop_tripcount min=(rows_blk_min) max=(rows_blk_max)
+                #pragma HLS loop_tripcount min=(rows_min) max=(rows_max)
 
-                indvec_k2k_t row_buffer = in_rows_str.read();
-                #pragma HLS array_partition variable=row_buffer.items complete dim=0
+                if (lane == 0) {
+                    if (entry_ind%BLOCK_SIZE == 0) {
+                        row_buffer = in_rows_str.read();
 #if DEBUG 
-                if (DEBUG&2) printf ("k2::read_rows(): block read, id: %d\n", i);
-#endif
-                for (unsigned int j=0; j<BLOCK_SIZE; j++) {
-                    #pragma HLS UNROLL
-                    row_ptr[i*BLOCK_SIZE+j] = row_buffer.items[j]; 
-#if DEBUG 
-                    if (DEBUG&2) printf (", %d\n", row_buffer.items[j]);
+                        if (DEBUG&2) printf ("k2::read_rows(): block read, id: %d\n", entry_ind/BLOCK_SIZE);
 #endif
+                    }
+                    row_entry = row_buffer.items[entry_ind%BLOCK_SIZE];
+                    entry_ind++;
                 }
-#if DEBUG
-                if (DEBUG&2) printf ("\n");
-#endif
-            }
-
-            row_write: 
-            for (unsigned int i=0; i<=y_len; i++) {  
-                #pragma HLS PIPELINE II=1
-                #pragma HLS loop_tripcount min=(rows_min) max=(rows_max)
+                tile_end = row_entry == ROW_ENTRY_END;
+                bool slice = !tile_end && (row_entry & ROW_ENTRY_SLICE);
+                bool skip = !tile_end && (row_entry & ROW_ENTRY_MASK) == 0; // COO lanes inside a row
 
                 indind_t row_item;
-                row_item.index = i == y_len ? VECTOR_SIZE+BLOCK_SIZE-1 : i; // Invalid index...
-                row_item.is_last = i == y_len;
-                row_item.value = i == y_len ? BLOCK_SIZE : row_ptr[i+1] - row_ptr[i]; // Invalid size for "aggregation" single iteration
+                row_item.index = tile_end ? VECTOR_SIZE+BLOCK_SIZE-1 : (row_entry >> ROW_ENTRY_SHIFT) + lane; // Invalid index...
+                row_item.is_last = tile_end;
+                // Invalid size for "aggregation" single iteration, a slice's row has its sum in one product item
+                row_item.value = tile_end ? BLOCK_SIZE : slice ? 1 : row_entry & ROW_ENTRY_MASK;
+                lane = slice && lane < BLOCK_SIZE-1 ? lane+1 : 0;
                 
                 pkt_ind_nnz v;
                 row_item.set(v.data);
-
-                if (row_item.value > 0) {
+                if (!skip) {
                     out_row_tupple.write(v); 
                 }
 
 #if DEBUG 
-                if (DEBUG&2) printf ("k2::read_rows(): row sent:%d, i: %d", row_item.value > 0, i);
+                if (DEBUG&2) printf ("k2::read_rows(): row sent: %d", row_item.index);
                 if (DEBUG&2) printf (", nnzs: %d", row_item.value);
                 if (DEBUG&2) printf (", is_last: %d\n", row_item.is_last);
 #endif
@@ -101,7 +90,8 @@ void read_rows(
 void read_products(
         hls::stream<pkt_block> &out_prod,
         hls::stream<valvec_k2k_t> &in_prod_str,
-        const unsigned int nnz_blocks,
+        hls::stream<indvec_k2k_t> &in_perf_str,
+        const unsigned int prod_blocks,
         const unsigned int runs) {
 #if DEBUG 
     if (DEBUG&1) printf ("k2::read_products(): start\n");
@@ -109,12 +99,12 @@ void read_products(
     // XRT 2.15 i.e 2023.1: Pragma conflict happens on 'INLINE' and DATAFLOW pragmas: Inline into dataflow region may break the canonical form.
     // #pragma HLS INLINE
 
-    assert(nnz_blocks>0);
+    assert(prod_blocks>0);
     out_prods: 
     for (unsigned int h=0; h<runs; h++) {
         #pragma HLS PIPELINE OFF
 
-        for (unsigned int i=0; i<nnz_blocks; i++) {
+        for (unsigned int i=0; i<prod_blocks; i++) {
             #pragma HLS PIPELINE II=1
             #pragma HLS loop_tripcount min=(nnz_blk_min) max=(nnz_blk_max)
 
@@ -127,6 +117,12 @@ void read_products(
             out_prod.write(v);
         }
     }
+#if PERF_COUNTERS
+    indvec_k2k_t perf = in_perf_str.read(); // Behind the products, for k3 to relay
+    pkt_block v;
+    perf.set(v.data);
+    out_prod.write(v);
+#endif
 #if DEBUG 
         if (DEBUG&1) printf ("k2::read_products(): end\n");
 #endif
@@ -136,10 +132,11 @@ void read_products(
 void mult_values(
         hls::stream<indvec_k2k_t> &out_rows,
         hls::stream<valvec_k2k_t> &out_prod,
+        hls::stream<indvec_k2k_t> &out_perf,
         hls::stream<pkt_block> &in_indices, 
         hls::stream<pkt_block> &in_values,
+        hls::stream<pkt_block> &in_vector,
         const unsigned int x_blocks,
-        const unsigned int row_blocks, 
         // const unsigned int nnz_blocks_vec[BLOCK_SIZE],
         const unsigned int tiles,
         const unsigned int runs) { 
@@ -151,12 +148,47 @@ void mult_values(
 #endif
 #define TILE_BLOCKS 5
 
+    // Ping-pong x segments: the next tile's segment is loaded while the current one is multiplied
+    // Todo: Fix the vector_size according to the distribution
+    prec_t vector[2][VECTOR_SIZE+BLOCK_SIZE]; 
+#if URAM
+    #pragma HLS BIND_STORAGE variable=vector type=RAM_1WNR impl=URAM
+#else
+    #pragma HLS BIND_STORAGE variable=vector type=RAM_1WNR impl=BRAM
+#endif
+    #pragma HLS ARRAY_PARTITION variable=vector type=complete dim=1
+    #pragma HLS ARRAY_PARTITION variable=vector type=cyclic factor=16 dim=2 // A block written per cycle
+
+    // Entries (first row and width) of a sliced tile's slices, a block of slice entries written per cycle
+    int slice_entries[SELL_SLICES/BLOCK_SIZE+1][BLOCK_SIZE];
+    #pragma HLS ARRAY_PARTITION variable=slice_entries type=complete dim=2
+
+    // Lane-wise partial sums of the current SELL slice, rotated as the row sums of k4's accumulate_rows
+    prec_t slice_reg[SELL_II][BLOCK_SIZE];
+    #pragma HLS ARRAY_PARTITION variable=slice_reg type=complete dim=0
+
+    unsigned int active = 0, in_stall = 0, out_stall = 0, blocks = 0, tiles_done = 0; // See PERF_*
+
     assert(runs>0);
     for (unsigned int h=0; h<runs; h++) {
         #pragma HLS PIPELINE OFF
         indvec_k2k_t nnz_blocks_vec;
-        auto nnz_blocks_val = in_indices.read();
-        nnz_blocks_vec.get(nnz_blocks_val.data);
+        unsigned int cur = 0;
+
+        vec_read: // First tile's segment
+        for (unsigned int i=0; i<x_blocks; i++) {
+            #pragma HLS PIPELINE II=1
+            #pragma HLS loop_tripcount min=(vec_blk_min) max=(vec_blk_max)
+            active++;
+            in_stall += in_vector.empty();
+            pkt_block v = in_vector.read();
+            valvec_k2k_t vec_buffer;
+            vec_buffer.get(v.data);
+            for (unsigned int j=0; j<BLOCK_SIZE; j++) {
+                #pragma HLS UNROLL
+                vector[0][i*BLOCK_SIZE+j] = vec_buffer.items[j]; 
+            }
+        }
 
         assert(tiles>0);
     tiles:
@@ -167,71 +199,185 @@ void mult_values(
 #if DEBUG
             if (DEBUG&1) printf ("k2::mult_values(): start of tile: %d\n", tile);
 #endif
-            int nnz_blocks = nnz_blocks_vec.items[tile];
+            if (tile%BLOCK_SIZE == 0) { // Tile descriptors: a block ahead of every BLOCK_SIZE tiles
+                auto nnz_blocks_val = in_indices.read();
+                nnz_blocks_vec.get(nnz_blocks_val.data);
+            }
+            int tile_desc = nnz_blocks_vec.items[tile%BLOCK_SIZE];
+            int nnz_blocks = tile_desc & TILE_BLOCKS_MASK;
+            int format = tile_desc >> TILE_FORMAT_SHIFT;
+            bool bcsr = format == TILE_FORMAT_BCSR;
+            bool dia = format == TILE_FORMAT_DIA;
+            bool sliced = format == TILE_FORMAT_SELL || bcsr || dia; // A product block per slice
+            bool coo = format == TILE_FORMAT_COO;
 #if DEBUG 
-            if (DEBUG&1) printf ("k2::nnz_blocks: %d at current tile\n", nnz_blocks);
+            if (DEBUG&1) printf ("k2::nnz_blocks: %d at current tile, format: %d\n", nnz_blocks, format);
 #endif
+            bool rows_end = false;
+            indvec_k2k_t rows_end_block; // COO: written behind the row entries of its blocks
             out_rows: 
-            for (unsigned int i=0; i<row_blocks; i++) {
+            for (unsigned int i=0; !rows_end; i++) { // Row entry blocks up to the one with the end entry
                 #pragma HLS PIPELINE II=1
                 #pragma HLS loop_tripcount min=(rows_blk_min) max=(rows_blk_max)
+                active++;
+                in_stall += in_indices.empty();
+                out_stall += out_rows.full();
                 auto v = in_indices.read();
                 indvec_k2k_t row_buffer;
                 #pragma HLS array_partition variable=row_buffer.items complete dim=0
                 row_buffer.get(v.data);
-                out_rows.write(row_buffer);
+                for (unsigned int j=0; j<BLOCK_SIZE; j++) {
+                    #pragma HLS UNROLL
+                    rows_end |= row_buffer.items[j] == ROW_ENTRY_END;
+                    if (sliced) {
+                        slice_entries[i][j] = row_buffer.items[j];
+                    }
+                }
+                if (coo) {
+                    rows_end_block = row_buffer;
+                } else {
+                    out_rows.write(row_buffer);
+                }
             }
 
-            // Todo: Fix the vector_size according to the distribution
-            prec_t vector[VECTOR_SIZE+BLOCK_SIZE]; 
-            #pragma HLS BIND_STORAGE variable=vector type=RAM_1WNR impl=BRAM
-            // #pragma HLS ARRAY_RESHAPE variable=vector type=cyclic factor=16 
-            #pragma HLS ARRAY_PARTITION variable=vector type=cyclic factor=4
-            vec_read: 
-            for (unsigned int i=0; i<x_blocks; i++) {
-                #pragma HLS PIPELINE II=4
-                #pragma HLS loop_tripcount min=(vec_blk_min) max=(vec_blk_max)
-                pkt_block v = in_values.read();
-                valvec_k2k_t vec_buffer;
-                vec_buffer.get(v.data);
+            bool next_read = tile+1 < tiles;
+            unsigned int steps = next_read && x_blocks > nnz_blocks ? x_blocks : nnz_blocks;
+            unsigned int nxt = !cur;
+            unsigned int slice = 0, slice_block = 0;
+            indvec_k2k_t buff_cols; // BCSR: a column block serves BLOCK_SIZE value blocks, DIA: the tile's offsets
+            #pragma HLS array_partition variable=buff_cols.items complete dim=0
+            for (unsigned int k=0; k<SELL_II; k++) {
+                #pragma HLS UNROLL
                 for (unsigned int j=0; j<BLOCK_SIZE; j++) {
                     #pragma HLS UNROLL
-                    vector[i*BLOCK_SIZE+j] = vec_buffer.items[j]; 
+                    slice_reg[k][j] = 0;
                 }
             }
-
-            // unsigned int nnzs_start = x_blocks;
-            // unsigned int nnzs_end = x_blocks+nnz_blocks;
             values_mult_blocked: 
-            for (int i=0; i<nnz_blocks; i++) {
+            for (unsigned int i=0; i<steps; i++) {
                 #pragma HLS PIPELINE II=1
+                #pragma HLS DEPENDENCE variable=vector type=inter false // The two halves are disjoint
+                #pragma HLS DEPENDENCE variable=vector type=intra false
                 #pragma HLS loop_tripcount min=(nnz_blk_min) max=(nnz_blk_max)
+                active++;
+                bool cols_read = bcsr ? i%BLOCK_SIZE == 0 : !dia || i == 0;
+                in_stall += (next_read && i < x_blocks && in_vector.empty()) 
+                    || (i < nnz_blocks && ((cols_read && in_indices.empty()) || in_values.empty()));
+                out_stall += i < nnz_blocks && out_prod.full();
+
+                if (next_read && i < x_blocks) { // Next tile's segment
+                    pkt_block v = in_vector.read();
+                    valvec_k2k_t vec_buffer;
+                    vec_buffer.get(v.data);
+                    for (unsigned int j=0; j<BLOCK_SIZE; j++) {
+                        #pragma HLS UNROLL
+                        vector[nxt][i*BLOCK_SIZE+j] = vec_buffer.items[j]; 
+                    }
+                }
 
-                auto v1 = in_indices.read();
-                auto v2 = in_values.read();
-                
-                indvec_k2k_t buff_cols;
-                buff_cols.get(v1.data);
-                valvec_k2k_t buff_values;
-                buff_values.get(v2.data);
+                if (i < nnz_blocks) {
+                    if (cols_read) {
+                        auto v1 = in_indices.read();
+                        buff_cols.get(v1.data);
+                    }
+                    auto v2 = in_values.read();
+                    
+                    int block_entry = buff_cols.items[i%BLOCK_SIZE]; // BCSR
+                    int slice_entry = slice_entries[slice/BLOCK_SIZE][slice%BLOCK_SIZE]; // SELL, BCSR, DIA
+                    int diag_first = (slice_entry >> ROW_ENTRY_SHIFT) + buff_cols.items[slice_block%BLOCK_SIZE]; // DIA
+                    valvec_k2k_t buff_values;
+                    buff_values.get(v2.data);
 #if DEBUG 
-                if (DEBUG&2) printf ("k2::mult-block: %d\n", i);
+                    if (DEBUG&2) printf ("k2::mult-block: %d\n", i);
 #endif
-                valvec_k2k_t res_block;
-                mult: 
-                for (unsigned int j=0; j<BLOCK_SIZE; j++) {
-                    #pragma HLS UNROLL
-                    // #pragma HLS BIND_OP variable=res_block.items op=fmul impl=meddsp
-                    res_block.items[j] = buff_values.items[j] * vector[buff_cols.items[j]];
+                    valvec_k2k_t res_block;
+                    mult: 
+                    for (unsigned int j=0; j<BLOCK_SIZE; j++) {
+                        #pragma HLS UNROLL
+                        // #pragma HLS BIND_OP variable=res_block.items op=fmul impl=meddsp
+                        int col = bcsr ? (block_entry & ROW_ENTRY_MASK) + j%BCSR_C 
+                            : coo ? buff_cols.items[j] & ROW_ENTRY_MASK : buff_cols.items[j];
+                        if (dia) { // A contiguous x window, past the segment's edges the values are padding
+                            int diag_col = diag_first + (int) j;
+                            col = diag_col >= 0 && diag_col < (int) (x_blocks*BLOCK_SIZE) ? diag_col : 0;
+                        }
+                        res_block.items[j] = buff_values.items[j] * vector[cur][col];
 #if DEBUG 
-                    if (DEBUG&2) printf ("%f*%f,", res_block.items[j], vector[buff_cols.items[j]]);
+                        if (DEBUG&2) printf ("%f*%f,", res_block.items[j], vector[cur][col]);
 #endif
-                }
+                    }
 #if DEBUG 
-                if (DEBUG&2) printf ("\n");
+                    if (DEBUG&2) printf ("\n");
 #endif
-                out_prod.write(res_block);
+                    if (coo) { // A row entry per row of the block, as a row never crosses a COO block
+                        indvec_k2k_t run_entries;
+                        for (unsigned int j=0; j<BLOCK_SIZE; j++) {
+                            #pragma HLS UNROLL
+                            int row = buff_cols.items[j] >> ROW_ENTRY_SHIFT;
+                            bool start = j == 0 || row != (buff_cols.items[j > 0 ? j-1 : 0] >> ROW_ENTRY_SHIFT);
+                            bool run = true;
+                            int len = 0;
+                            for (unsigned int k=0; k<BLOCK_SIZE; k++) {
+                                #pragma HLS UNROLL
+                                run &= k < j || (buff_cols.items[k] >> ROW_ENTRY_SHIFT) == row;
+                                len += k >= j && run;
+                            }
+                            run_entries.items[j] = start ? (row << ROW_ENTRY_SHIFT) | len : ROW_ENTRY_SKIP;
+                        }
+                        out_rows.write(run_entries);
+                    }
+
+                    if (bcsr) { // The block's row sums, into the lanes of its rows in the slice
+                        unsigned int block_row = block_entry >> ROW_ENTRY_SHIFT;
+                        prec_t row_sums[BCSR_R];
+                        #pragma HLS array_partition variable=row_sums complete dim=0
+                        for (unsigned int r=0; r<BCSR_R; r++) {
+                            #pragma HLS UNROLL
+                            row_sums[r] = 0;
+                            for (unsigned int c=0; c<BCSR_C; c++) {
+                                #pragma HLS UNROLL
+                                row_sums[r] += res_block.items[r*BCSR_C+c];
+                            }
+                        }
+                        for (unsigned int j=0; j<BLOCK_SIZE; j++) {
+                            #pragma HLS UNROLL
+                            res_block.items[j] = j/BCSR_R == block_row ? row_sums[j%BCSR_R] : (prec_t) 0;
+                        }
+                    }
+
+                    // SELL, BCSR, DIA: the slice's blocks are summed lane-wise, its last block writes the row sums
+                    bool slice_end = slice_block+1 == (slice_entry & (ROW_ENTRY_SLICE-1));
+                    for (unsigned int j=0; sliced && j<BLOCK_SIZE; j++) {
+                        #pragma HLS UNROLL
+                        prec_t prev_sum = 0;
+                        for (unsigned int k=0; k<SELL_II; k++) {
+                            #pragma HLS UNROLL
+                            prev_sum += slice_reg[k][j];
+                        }
+                        prec_t prod = res_block.items[j];
+                        res_block.items[j] = prev_sum + prod;
+                        prec_t oldest = slice_reg[0][j]; // Written SELL_II blocks ago, before the shift
+                        for (unsigned int k=0; k<SELL_II-1; k++) { // Shift or reset
+                            #pragma HLS UNROLL
+                            slice_reg[k][j] = slice_end ? 0 : slice_reg[k+1][j];
+                        }
+                        slice_reg[SELL_II-1][j] = slice_end ? 0 : oldest + prod;
+                    }
+                    if (sliced) {
+                        slice_block = slice_end ? 0 : slice_block+1;
+                        slice += slice_end;
+                    }
+                    if (!sliced || slice_end) {
+                        out_prod.write(res_block);
+                    }
+                }
+            }
+            if (coo) {
+                out_rows.write(rows_end_block);
             }
+            cur = nxt;
+            blocks += nnz_blocks;
+            tiles_done++;
    
 #if DEBUG
         if (DEBUG&1) printf ("k2::mult_values(): end of tile: %d\n", tile);
@@ -240,6 +386,12 @@ void mult_values(
                   
     }
 
+#if PERF_COUNTERS
+    indvec_k2k_t perf;
+    perf_block(perf, 2, active, in_stall, out_stall, blocks, tiles_done);
+    out_perf.write(perf);
+#endif
+
 #if DEBUG 
         if (DEBUG&1) printf ("k2::mult_values(): end\n");
 #endif
@@ -252,48 +404,46 @@ extern "C" {
             hls::stream<pkt_block>& out_prod,
             hls::stream<pkt_block>& in_indices,
             hls::stream<pkt_block>& in_values,
+            hls::stream<pkt_block>& in_vector,
             const unsigned int x_blocks,
-            const unsigned int row_blocks,
-            const unsigned int y_len, 
             // const unsigned int nnz_blocks_vec[BLOCK_SIZE],
             const unsigned int tiles,
-            const unsigned int nnz_blocks_tot,
+            const unsigned int prod_blocks_tot, // nnz blocks of the CSR tiles, slices of the sliced ones
             const unsigned int runs) {
         
         #pragma HLS INTERFACE axis port = out_row_tupples
         #pragma HLS INTERFACE axis port = out_prod
         #pragma HLS INTERFACE axis port = in_indices
         #pragma HLS INTERFACE axis port = in_values
+        #pragma HLS INTERFACE axis port = in_vector
 
         // #pragma HLS INTERFACE m_axi port = nnz_blocks_vec offset=slave max_read_burst_length=16 // bundle=gmem2
 
         #pragma HLS INTERFACE s_axilite port = x_blocks 
-        #pragma HLS INTERFACE s_axilite port = row_blocks
-        #pragma HLS INTERFACE s_axilite port = y_len
         #pragma HLS INTERFACE s_axilite port = tiles
-        #pragma HLS INTERFACE s_axilite port = nnz_blocks_tot
+        #pragma HLS INTERFACE s_axilite port = prod_blocks_tot
 
 #if DEBUG 
         if (DEBUG&1) printf ("k2::x_blocks: %d\n", x_blocks);
-        if (DEBUG&1) printf ("k2::row_blocks: %d\n", row_blocks);
-        if (DEBUG&1) printf ("k2::y_len: %d\n", y_len);
         if (DEBUG&1) printf ("k2::tiles: %d\n", tiles);
-        if (DEBUG&1) printf ("k2::nnz_blocks_tot: %d\n", nnz_blocks_tot);
+        if (DEBUG&1) printf ("k2::prod_blocks_tot: %d\n", prod_blocks_tot);
 #endif
 
         const unsigned int str_depth = 2048; //
         static hls::stream<indvec_k2k_t> rows_stream;
         static hls::stream<valvec_k2k_t> prod_stream;
+        static hls::stream<indvec_k2k_t> perf_stream;
         #pragma HLS STREAM variable=rows_stream depth=str_depth 
         #pragma HLS STREAM variable=prod_stream depth=16 
+        #pragma HLS STREAM variable=perf_stream depth=2 
 
         #pragma HLS DATAFLOW
 
         // mult_values(rows_stream, out_prod, in_indices, in_values, x_blocks, row_blocks, nnz_blocks_vec, tiles);
         // read_rows(out_row_tupples, rows_stream, y_len, row_blocks, tiles);
 
-        mult_values(rows_stream, prod_stream, in_indices, in_values, x_blocks, row_blocks, /*nnz_blocks_vec,*/ tiles, runs);
-        read_products(out_prod, prod_stream, nnz_blocks_tot, runs);
-        read_rows(out_row_tupples, rows_stream, y_len, row_blocks, tiles, runs); 
+        mult_values(rows_stream, prod_stream, perf_stream, in_indices, in_values, in_vector, x_blocks, /*nnz_blocks_vec,*/ tiles, runs);
+        read_products(out_prod, prod_stream, perf_stream, prod_blocks_tot, runs);
+        read_rows(out_row_tupples, rows_stream, tiles, runs); 
     }
 }
\ No newline at end of file
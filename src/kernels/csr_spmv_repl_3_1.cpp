@@ -106,6 +106,8 @@ void data_prefix_sum(
     if (DEBUG&1) printf ("k3::data_prefix_sum(): start\n");
 #endif
 
+    unsigned int active = 0, in_stall = 0, out_stall = 0, blocks = 0, tiles_done = 0; // See PERF_*
+
     assert(runs>0);
     runs:
     for (unsigned int h=0; h<runs; h++) {
@@ -125,6 +127,8 @@ void data_prefix_sum(
             row_sum:
             for (/*int i=0*/; true; /*i++*/) {
                 #pragma HLS PIPELINE II=1
+                active++;
+                in_stall += in_row_marks.empty();
                 indmsk_t row_mark = in_row_marks.read();
 #if DEBUG
                     if (DEBUG&2)  printf  ("k3::data_prefix_sum(): row_mark read, row: %d", row_mark.index);
@@ -135,6 +139,9 @@ void data_prefix_sum(
 
                 if (row_mark.is_last) break;
 
+                in_stall += row_mark.is_blk_read && in_data.empty();
+                out_stall += out_rows.full();
+                blocks += row_mark.is_blk_read;
                 pkt_block v2 = row_mark.is_blk_read ? in_data.read() : pkt_block();
                 row_mark.is_blk_read ? prod_block.get(v2.data) : 0;
 
@@ -170,12 +177,30 @@ void data_prefix_sum(
             pkt_ind_val v4;
             row_res.set(v4.data);
             out_rows.write(v4);       
+            tiles_done++;
 
     #if DEBUG
             if (DEBUG&1) printf ("k3::data_prefix_sum(): end of tile: %d\n", tile);
     #endif   
         }
     }  
+
+#if PERF_COUNTERS
+    // k2's block behind its products, relayed with this kernel's block as raw (item, value) pairs
+    indvec_k2k_t perf[2];
+    pkt_block v5 = in_data.read();
+    perf[0].get(v5.data);
+    perf_block(perf[1], 3, active, in_stall, out_stall, blocks, tiles_done);
+    perf_relay:
+    for (unsigned int i=0; i<2*PERF_ITEMS; i++) {
+        #pragma HLS PIPELINE II=1
+        pkt_ind_val v6;
+        v6.data.range(INDEX_SIZE-1, 0) = i;
+        v6.data.range(2*INDEX_SIZE-1, INDEX_SIZE) = perf[i/PERF_ITEMS].items[i%PERF_ITEMS];
+        v6.data.range(INDEX_SIZE+PREC_SIZE+1, INDEX_SIZE+PREC_SIZE) = 0;
+        out_rows.write(v6);
+    }
+#endif
 }   
 
     
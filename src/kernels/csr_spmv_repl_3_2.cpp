@@ -11,6 +11,7 @@
 void accumulate_rows(
         hls::stream<pkt_ind_val>& in_rows,
         hls::stream<indval_t>& out_row,
+        hls::stream<indvec_k2k_t>& out_perf,
         const unsigned int tiles,
         const unsigned int runs) {
     
@@ -20,6 +21,8 @@ void accumulate_rows(
     if (DEBUG&1) printf  ("k4::accumulate_rows(): start \n");
 #endif
     // TODO: Consider getting rid of the result array alltogether, but at the cost of concurrent R&W ops to HBM
+    unsigned int active = 0, in_stall = 0, out_stall = 0, rows = 0, tiles_done = 0; // See PERF_*
+
     assert(runs>0);
     runs:
     for (unsigned int h=0; h<runs; h++) {
@@ -50,7 +53,9 @@ void accumulate_rows(
             row_accum:                 
             do {
                 #pragma HLS PIPELINE II=1
-                #pragma HLS LOOP_TRIPCOUNT min=(rows_min) max=(rows_max) // Not true in the case of emtpy rows though
+                #pragma HLS LOOP_TRIPCOUNT min=(rows_min) max=(rows_max) // Non-empty rows only
+                active++;
+                in_stall += in_rows.empty();
                 pkt_ind_val v = in_rows.read();
                 row.get(v.data);
 
@@ -88,6 +93,8 @@ void accumulate_rows(
                 
                 row.prev_sum = prev_sum;
                 if (row.is_write) {
+                    out_stall += out_row.full();
+                    rows++;
                     out_row.write(row);
                 }
 
@@ -97,12 +104,35 @@ void accumulate_rows(
 
             indval_t last {.index=VECTOR_SIZE+BLOCK_SIZE-1, .value=0, .is_last=true, .is_write=false};
             out_row.write(last);
+            tiles_done++;
         }
     }
+
+#if PERF_COUNTERS
+    // k2's and k3's blocks as relayed by k3, then this kernel's to be completed by write_results
+    indvec_k2k_t perf[3];
+    perf_read:
+    for (unsigned int i=0; i<2*PERF_ITEMS; i++) {
+        #pragma HLS PIPELINE II=1
+        pkt_ind_val v = in_rows.read();
+        unsigned int item = v.data.range(INDEX_SIZE-1, 0);
+        perf[item/PERF_ITEMS].items[item%PERF_ITEMS] = v.data.range(2*INDEX_SIZE-1, INDEX_SIZE);
+    }
+    for (unsigned int i=0; i<2; i++) {
+        for (unsigned int j=PERF_ITEMS; j<BLOCK_SIZE; j++) {
+            #pragma HLS UNROLL
+            perf[i].items[j] = 0;
+        }
+        out_perf.write(perf[i]);
+    }
+    perf_block(perf[2], 4, active, in_stall, out_stall, rows, tiles_done);
+    out_perf.write(perf[2]);
+#endif
 }
 
 void write_results(
     hls::stream<indval_t>& in_rows,
+    hls::stream<indvec_k2k_t>& in_perf,
     hls::stream<pkt_block>& out_y,
     const unsigned int y_blocks,
     const unsigned int tiles,
@@ -115,17 +145,33 @@ void write_results(
 #endif
     // TODO: Consider getting rid of the result array alltogether, but at the cost of concurrent R&W ops to HBM
 
-    prec_t result[VECTOR_SIZE+BLOCK_SIZE]; 
-    #pragma HLS ARRAY_PARTITION variable=result type=cyclic factor=8
+    // Zero at configuration and left zeroed by res_write, so only the blocks updated by a run are cleared
+    static prec_t result[VECTOR_SIZE+BLOCK_SIZE]; 
+    #pragma HLS ARRAY_PARTITION variable=result type=cyclic factor=16
+#if URAM
+    #pragma HLS BIND_STORAGE variable=result type=RAM_2P impl=URAM
+#endif
+    static bool dirty[(VECTOR_SIZE+BLOCK_SIZE-1)/BLOCK_SIZE+1]; // Block updated in the current run
+    #pragma HLS ARRAY_PARTITION variable=dirty complete dim=0
+    unsigned short dirty_blocks[(VECTOR_SIZE+BLOCK_SIZE-1)/BLOCK_SIZE+1]; // Updated blocks in order
+    unsigned int dirty_count = 0;
+    unsigned int active = 0, in_stall = 0, out_stall = 0; // See PERF_*
 
     for (unsigned int h=0; h<runs; h++) {
         #pragma HLS PIPELINE OFF
-        res_init:    
-        for (int j=0; j<VECTOR_SIZE+BLOCK_SIZE; j++) {
-            #pragma HLS UNROLL factor=16
+        res_clear: // Blocks of the previous run
+        for (unsigned int i=0; i<dirty_count; i++) {
             #pragma HLS PIPELINE II=1
-            result[j] = 0;
+            #pragma HLS loop_tripcount min=0 max=(rows_blk_max)
+            active++;
+            unsigned int block = dirty_blocks[i];
+            for (unsigned int j=0; j<BLOCK_SIZE; j++) {
+                #pragma HLS UNROLL
+                result[block*BLOCK_SIZE+j] = 0;
+            }
+            dirty[block] = false;
         }
+        dirty_count = 0;
 
         assert(tiles>0);
         tiles:
@@ -138,21 +184,31 @@ void write_results(
             if (DEBUG&1)  printf  ("k4::write_results(): start of tile: %d\n", tile);
 #endif
             indval_t row;
-            loc_write: // Warning: This does not take empty row into account!   
+            loc_write: // Only the non-empty rows arrive
             do {
                 #pragma HLS PIPELINE II=1
                 #pragma HLS DEPENDENCE variable=result type=inter false
                 #pragma HLS LOOP_TRIPCOUNT min=100
+                active++;
+                in_stall += in_rows.empty();
                 row = in_rows.read();
                 result[row.index] += row.value + row.prev_sum;
+
+                unsigned int block = row.index/BLOCK_SIZE;
+                if (!row.is_last && !dirty[block]) {
+                    dirty[block] = true;
+                    dirty_blocks[dirty_count++] = block;
+                }
             } while (!row.is_last);
         }
     }
 
-    res_write: 
+    res_write: // The y partition of the CU, cleared behind for the next invocation
     for (unsigned int i=0; i<y_blocks; i++) { // The possible trailing buffer is also wrote
         #pragma HLS PIPELINE II=1
         #pragma HLS loop_tripcount min=(rows_blk_min) max=(rows_blk_max)
+        active++;
+        out_stall += out_y.full();
         valvec_k2k_t res_buffer;
         #pragma HLS array_partition variable=res_buffer.items complete dim=0
 #if DEBUG
@@ -161,6 +217,7 @@ void write_results(
         for (unsigned int j=0; j<BLOCK_SIZE; j++) {
             #pragma HLS UNROLL
             res_buffer.items[j] = result[i*BLOCK_SIZE+j];
+            result[i*BLOCK_SIZE+j] = 0;
 #if DEBUG
             if (DEBUG&2) std::cout<< res_buffer.items[j] << ", ";
             if (DEBUG&2)  printf  ("%f,", res_buffer.items[j] );
@@ -170,11 +227,29 @@ void write_results(
         if (DEBUG&2) std::cout<< std::endl;
         if (DEBUG&2)  printf  ("\n");
 #endif
+        dirty[i] = false;
         pkt_block v;
         res_buffer.set(v.data);
         out_y.write(v);
     }
 
+#if PERF_COUNTERS
+    perf_write: // Behind the y partition: k2's, k3's and this kernel's blocks, for k1 to write out
+    for (unsigned int i=0; i<PERF_BLOCKS-1; i++) {
+        #pragma HLS PIPELINE II=1
+        indvec_k2k_t perf = in_perf.read();
+        if (i == PERF_BLOCKS-2) { // The busier of the two processes
+            perf.items[PERF_ACTIVE_INDEX] = active > (unsigned int) perf.items[PERF_ACTIVE_INDEX] ? 
+                active : perf.items[PERF_ACTIVE_INDEX];
+            perf.items[PERF_IN_STALL_INDEX] += in_stall;
+            perf.items[PERF_OUT_STALL_INDEX] += out_stall;
+        }
+        pkt_block v;
+        perf.set(v.data);
+        out_y.write(v);
+    }
+#endif
+
 #if DEBUG
     if (DEBUG&1)  printf  ("k4::write_results(): end\n");
 #endif
@@ -206,12 +281,14 @@ extern "C" {
 
         const unsigned int str_depth = 16; //
         static hls::stream<indval_t> row_res;
+        static hls::stream<indvec_k2k_t> perf_res;
         #pragma HLS STREAM variable=row_res depth=str_depth 
+        #pragma HLS STREAM variable=perf_res depth=PERF_BLOCKS
 
         #pragma HLS DATAFLOW
 
-        accumulate_rows(in_rows, row_res, tiles, runs);
-        write_results(row_res, out_y, y_blocks, tiles, runs);
+        accumulate_rows(in_rows, row_res, perf_res, tiles, runs);
+        write_results(row_res, perf_res, out_y, y_blocks, tiles, runs);
     }
 }
 
@@ -9,18 +9,51 @@
 #include "hls_stream.h"
 // #include "hls_print.h" // See: https://docs.xilinx.com/r/en-US/ug1399-vitis-hls/HLS-Print-Function
 
+#include "xlx_interface.hpp"
+
 typedef float prec_t;
 typedef int prec_int_t;
 
 // Set
 #define DEBUG 0 // Turn off before synthesis
+
+// Build variant: URAM=1 keeps the x segments and the y partition in URAM, for a larger tile side length
+#ifndef URAM
+#define URAM 0
+#endif
+
+#ifndef VECTOR_SIZE
+#if URAM
+#define VECTOR_SIZE 16384 // Square tile side length
+#else
 #define VECTOR_SIZE 1875 // Square tile side length
+#endif
+#endif
 
 #define PREC_SIZE (sizeof(prec_t)*8)
 #define INDEX_SIZE (sizeof(int)*8)
 #define BURST_SIZE 512
 #define BLOCK_SIZE (BURST_SIZE/PREC_SIZE)
 
+static_assert(VECTOR_SIZE+BLOCK_SIZE < ROW_ENTRY_SLICE, "Row entries hold 15-bit rows and lengths");
+
+// Tile formats, see xlx_interface.hpp
+#define TILE_FORMATS ((1 << TILE_FORMAT_CSR) | (1 << TILE_FORMAT_SELL) | (1 << TILE_FORMAT_BCSR) \
+    | (1 << TILE_FORMAT_DIA) | (1 << TILE_FORMAT_COO)) // Decoded by these kernels
+#define SELL_SLICES ((VECTOR_SIZE+BLOCK_SIZE-1)/BLOCK_SIZE) // Per tile
+#define BCSR_R (BLOCK_SIZE/BCSR_C)
+static_assert(BCSR_R*BCSR_C == BLOCK_SIZE && BLOCK_SIZE%BCSR_R == 0, "A BCSR block fills a value block");
+#define DIA_DIAGONALS BLOCK_SIZE // Per tile, a column block
+#define SELL_II 5 // Partial sums rotated per slice lane, covering the fp add latency at II=1 (as k4's II)
+
+// Tiles per CU, 0 = unbounded as the tile descriptors are streamed (see mult_values)
+#define MAX_TILES 0
+
+// Performance counters (see xlx_interface.hpp), 0 leaves them out of the streams
+#ifndef PERF_COUNTERS
+#define PERF_COUNTERS 1
+#endif
+
 // K2K AXI stream types
 typedef ap_axiu<1, 0, 0, 0> pkt_sig;
 typedef ap_axiu<PREC_SIZE, 0, 0, 0> pkt_atomic;
@@ -231,4 +264,25 @@ typedef struct index_vector_k2k_type {
         }
     }
 
-} indvec_k2k_t; //TODO: reduce to single type with k2k
\ No newline at end of file
+} indvec_k2k_t; //TODO: reduce to single type with k2k
+
+// Counter block of a kernel, see PERF_*
+static inline void perf_block(
+        indvec_k2k_t &perf, 
+        const int kernel, 
+        const unsigned int active, 
+        const unsigned int in_stall, 
+        const unsigned int out_stall, 
+        const unsigned int blocks, 
+        const unsigned int tiles) {
+    for (unsigned int j=0; j<BLOCK_SIZE; j++) {
+        #pragma HLS UNROLL
+        perf.items[j] = 0;
+    }
+    perf.items[PERF_KERNEL_INDEX] = kernel;
+    perf.items[PERF_ACTIVE_INDEX] = active;
+    perf.items[PERF_IN_STALL_INDEX] = in_stall;
+    perf.items[PERF_OUT_STALL_INDEX] = out_stall;
+    perf.items[PERF_BLOCKS_INDEX] = blocks;
+    perf.items[PERF_TILES_INDEX] = tiles;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// Layout of the blocks the kernels and the host exchange, included by xlx_definitions.hpp and by
+// the host (xrt_utility.hpp, tile_formats.hpp). Plain defines only, the host has no HLS headers.
+
+// Compact row entries of a tile: (row << ROW_ENTRY_SHIFT) | row nnz, for its non-empty rows only.
+// The entries are closed by ROW_ENTRY_END, and the rest of that block is padding.
+#define ROW_ENTRY_SHIFT 16
+#define ROW_ENTRY_MASK ((1 << ROW_ENTRY_SHIFT)-1)
+#define ROW_ENTRY_END -1
+#define ROW_ENTRY_SKIP 0 // No nnz, see COO
+// SELL slice entry: (first row << ROW_ENTRY_SHIFT) | ROW_ENTRY_SLICE | width, for the non-empty slices only
+#define ROW_ENTRY_SLICE (1 << (ROW_ENTRY_SHIFT-1))
+
+// Tile formats, in the tile descriptor bits above the tile's nnz blocks (see mult_values of csr_spmv_repl_2):
+//   CSR   row entries, the nnz packed row after row
+//   SELL  sliced ELLPACK: slices of BLOCK_SIZE rows, padded to their longest row, with block k holding
+//         the k-th nnz of every row of the slice. mult_values sums the slice's blocks lane-wise, so a
+//         single product block per slice leaves k2, a row per lane.
+//   BCSR  blocked CSR: dense BCSR_R x BCSR_C blocks (a value block each, row-major) with a single
+//         (block row in the slice << ROW_ENTRY_SHIFT) | first column index per block, the blocks of a
+//         slice after another's under SELL's slice entries (width = its blocks). mult_values sums a
+//         block's rows into their lanes of the slice, the slice then leaves k2 as a SELL one.
+//   DIA   diagonals: a single column block of the tile's (at most DIA_DIAGONALS) diagonal offsets, no
+//         column per nnz. SELL's slices, block k holding the k-th diagonal of the slice's rows, whose 
+//         x is the contiguous window at the slice's first row plus the offset.
+//   COO   (row << ROW_ENTRY_SHIFT) | column per nnz and the end entry alone in the row entries. A row 
+//         never crosses a block (padded with its row's column 0), mult_values derives the row entries of
+//         each block, skip entries in the lanes after a row's first.
+#define TILE_FORMAT_SHIFT 28
+#define TILE_BLOCKS_MASK ((1 << TILE_FORMAT_SHIFT)-1)
+#define TILE_FORMAT_CSR 0
+#define TILE_FORMAT_SELL 1
+#define TILE_FORMAT_BCSR 2
+#define TILE_FORMAT_DIA 3
+#define TILE_FORMAT_COO 4
+#define TILE_FORMAT_COUNT 5
+#define BCSR_C 4 // Block columns, BCSR_R (BLOCK_SIZE/BCSR_C) rows fill a value block
+
+// Capacity block written by csr_spmv_caps, one item per limit. The host sizes the partitioning from it.
+#define CAPS_MAGIC 0x48695370 // "HiSp"
+#define CAPS_MAGIC_INDEX 0
+#define CAPS_VECTOR_SIZE_INDEX 1
+#define CAPS_BLOCK_SIZE_INDEX 2
+#define CAPS_MAX_TILES_INDEX 3
+#define CAPS_PREC_SIZE_INDEX 4
+#define CAPS_URAM_INDEX 5
+#define CAPS_PERF_COUNTERS_INDEX 6
+#define CAPS_TILE_FORMATS_INDEX 7
+
+// Performance counters: a block per kernel of the CU, relayed down the k2k streams and written by 
+// csr_spmv_repl_1 behind the y partition at the end of a launch
+#define PERF_BLOCKS 4 // csr_spmv_repl_1..4
+#define PERF_ITEMS 6 // Items relayed per block
+#define PERF_KERNEL_INDEX 0 // 1..4
+#define PERF_ACTIVE_INDEX 1 // Trips of the II=1 loops (of the busiest dataflow process), i.e. issue cycles
+#define PERF_IN_STALL_INDEX 2 // Trips that found an input stream empty
+#define PERF_OUT_STALL_INDEX 3 // Trips that found an output stream full
+#define PERF_BLOCKS_INDEX 4 // Blocks processed, rows written for csr_spmv_repl_4
+#define PERF_TILES_INDEX 5 // Tiles processed
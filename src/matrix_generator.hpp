@@ -0,0 +1,215 @@
+/*
+MIT License
+
+Copyright (c) 2024 Abdul Rehman Tareen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../include/includes.hpp"
+#include "../include/csr_matrix.hpp"
+
+// Synthetic matrices of a controlled structure, built straight into CSR (sorted columns),
+// given in place of the matrix file as "gen:<kind>:<rows>[x<cols>][:<nnz per row>[:<seed>]]":
+//   band       nnz per row consecutive columns around the diagonal
+//   blockdiag  dense diagonal blocks of nnz per row side length
+//   random     nnz per row uniformly random columns
+//   rmat       R-MAT (a, b, c, d = .57, .19, .19, .05) power-law rows and columns, nnz per row on average
+//   stencil5, stencil7, stencil27  2D/3D grid Laplacians, rows rounded down to a square/cube grid
+// Matrices are square unless cols are given (band, blockdiag and random only); the diagonal of a
+// non-square band/blockdiag runs from the first to the last corner.
+// Rows are generated independently from (seed, row), so a spec always gives the same matrix.
+
+static const std::string matrixGeneratorPrefix = "gen:";
+
+static inline bool IsGeneratedMatrix(const std::string &matrixFile) {
+    return matrixFile.compare(0, matrixGeneratorPrefix.size(), matrixGeneratorPrefix) == 0;
+}
+
+// SplitMix64, cheap to seed per row
+struct GeneratorRandom {
+    uint64_t state;
+
+    GeneratorRandom(uint64_t seed, uint64_t stream) : state(seed*0x9E3779B97F4A7C15ull ^ (stream+1)*0xD1B54A32D192ED03ull) { }
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    double uniform() { return (next() >> 11) * (1.0/9007199254740992.0); } // [0, 1)
+
+    uint64_t below(uint64_t bound) { return next() % bound; }
+};
+
+struct MatrixGeneratorSpec {
+    std::string kind;
+    uint64_t rows = 0;
+    uint64_t cols = 0;
+    uint64_t nnzPerRow = 0;
+    uint64_t seed = 1;
+    int gridDims = 0; // Stencils
+    uint64_t gridSide = 0;
+};
+
+static inline bool ParseMatrixGeneratorSpec(const std::string &matrixFile, MatrixGeneratorSpec &spec) {
+    std::stringstream ss(matrixFile.substr(matrixGeneratorPrefix.size()));
+    std::vector<std::string> fields;
+    for (std::string field; std::getline(ss, field, ':');) {
+        fields.push_back(field);
+    }
+    if (fields.size() < 2 || fields.size() > 4) return false;
+    try {
+        spec.kind = fields[0];
+        auto cross = fields[1].find('x');
+        spec.rows = std::stoull(fields[1].substr(0, cross));
+        if (cross != std::string::npos) spec.cols = std::stoull(fields[1].substr(cross+1));
+        if (fields.size() > 2) spec.nnzPerRow = std::stoull(fields[2]);
+        if (fields.size() > 3) spec.seed = std::stoull(fields[3]);
+    } catch (const std::exception &) {
+        return false;
+    }
+
+    if (spec.cols > 0 && spec.kind != "band" && spec.kind != "blockdiag" && spec.kind != "random") return false;
+    if (spec.kind == "stencil5" || spec.kind == "stencil7" || spec.kind == "stencil27") {
+        spec.gridDims = spec.kind == "stencil5" ? 2 : 3;
+        spec.gridSide = std::floor(std::pow((double) spec.rows, 1.0/spec.gridDims) + 1e-9);
+        spec.rows = spec.gridDims == 2 ? spec.gridSide*spec.gridSide : spec.gridSide*spec.gridSide*spec.gridSide;
+        spec.nnzPerRow = spec.kind == "stencil5" ? 5 : spec.kind == "stencil7" ? 7 : 27;
+    } else if (spec.kind != "band" && spec.kind != "blockdiag" && spec.kind != "random" && spec.kind != "rmat") {
+        return false;
+    }
+    if (spec.cols == 0) spec.cols = spec.rows;
+    spec.nnzPerRow = std::min(spec.nnzPerRow, spec.cols);
+    return spec.rows > 0 && spec.rows <= INT_MAX && spec.cols <= INT_MAX && spec.nnzPerRow > 0;
+}
+
+// Sorted, distinct columns of a row
+static inline void GenerateRowColumns(const MatrixGeneratorSpec &spec, const uint64_t row, std::vector<int> &cols) {
+    cols.clear();
+    int64_t n = spec.cols, k = spec.nnzPerRow;
+    int64_t diagonal = row*spec.cols/spec.rows;
+    GeneratorRandom random(spec.seed, row);
+
+    if (spec.kind == "band") {
+        int64_t first = std::min(std::max(diagonal - k/2, (int64_t) 0), n-k);
+        for (int64_t c=first; c<first+k; c++) cols.push_back(c);
+    } else if (spec.kind == "blockdiag") {
+        int64_t first = (diagonal/k)*k;
+        for (int64_t c=first; c<std::min(first+k, n); c++) cols.push_back(c);
+    } else if (spec.kind == "random") {
+        if (2*k > n) { // Dense rows keep each column with probability k/n
+            for (int64_t c=0; c<n; c++) if (random.uniform()*n < k) cols.push_back(c);
+        }
+        while (2*k <= n && (int64_t) cols.size() < k) { // Duplicates are drawn again
+            for (int64_t i=cols.size(); i<k; i++) cols.push_back(random.below(n));
+            std::sort(cols.begin(), cols.end());
+            cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+        }
+    } else if (spec.kind == "rmat") {
+        // The row's quadrant bits fix its share of the edges and the column bit odds at each level
+        const double a = 0.57, b = 0.19, c = 0.19, d = 0.05;
+        int levels = 0;
+        while ((int64_t) (1ull << levels) < n) levels++;
+        double expected = (double) n * k;
+        uint64_t rightAbove[64]; // A random word above it sets the column bit
+        for (int l=levels-1; l>=0; l--) {
+            bool bottom = (row >> l) & 1;
+            expected *= bottom ? c+d : a+b;
+            rightAbove[l] = (bottom ? c/(c+d) : a/(a+b)) * 18446744073709551615.0;
+        }
+        uint64_t degree = std::min((int64_t) (expected + random.uniform()), n);
+        for (int round=0; cols.size() < degree && round < 4; round++) { // Duplicates and columns past n are drawn again
+            for (auto i=cols.size(); i<degree; i++) {
+                uint64_t col = 0;
+                for (int l=levels-1; l>=0; l--) {
+                    col |= (uint64_t) (random.next() > rightAbove[l]) << l;
+                }
+                if (col < (uint64_t) n) cols.push_back(col);
+            }
+            std::sort(cols.begin(), cols.end());
+            cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+        }
+    } else { // Stencils
+        int64_t side = spec.gridSide;
+        int64_t x = row % side, y = (row / side) % side, z = spec.gridDims == 3 ? row / (side*side) : 0;
+        int64_t zr = spec.gridDims == 3 ? 1 : 0;
+        for (int64_t dz=-zr; dz<=zr; dz++) {
+            for (int64_t dy=-1; dy<=1; dy++) {
+                for (int64_t dx=-1; dx<=1; dx++) {
+                    int offsets = (dx != 0) + (dy != 0) + (dz != 0);
+                    if (spec.kind != "stencil27" && offsets > 1) continue; // 5/7-point: axis neighbours only
+                    int64_t nx = x+dx, ny = y+dy, nz = z+dz;
+                    if (nx < 0 || ny < 0 || nz < 0 || nx >= side || ny >= side || nz >= side) continue;
+                    cols.push_back((nz*side + ny)*side + nx);
+                }
+            }
+        }
+    }
+}
+
+template<typename T>
+static inline std::unique_ptr<CSRMatrix<T>> GenerateMatrixCSR(const std::string matrixFile, bool &read) {
+    std::unique_ptr<CSRMatrix<T>> matrix;
+    MatrixGeneratorSpec spec;
+    if (!(read = ParseMatrixGeneratorSpec(matrixFile, spec))) {
+        std::cout << "Invalid matrix generator spec " << matrixFile
+            << ", expected gen:<band|blockdiag|random|rmat|stencil5|stencil7|stencil27>:<rows>[x<cols>][:<nnz per row>[:<seed>]]" << std::endl;
+        return matrix;
+    }
+
+    // First pass counts the rows for the allocation, the second fills them
+    std::vector<int> cols;
+    uint64_t nnz = 0;
+    for (uint64_t row=0; row<spec.rows; row++) {
+        GenerateRowColumns(spec, row, cols);
+        nnz += cols.size();
+    }
+    if (!(read = nnz <= INT_MAX)) { // Row pointers are int
+        std::cout << "Generated matrix " << matrixFile << " has " << nnz << " nnz, more than " << INT_MAX << std::endl;
+        return matrix;
+    }
+
+    matrix.reset(new CSRMatrix<T>(nnz, spec.rows, spec.cols));
+    uint64_t ptr = 0;
+    for (uint64_t row=0; row<spec.rows; row++) {
+        matrix->setRowPointer(row, ptr);
+        GenerateRowColumns(spec, row, cols);
+        GeneratorRandom random(~spec.seed, row);
+        for (auto col : cols) {
+            matrix->setColIndex(ptr, col);
+            matrix->setData(ptr, (T) (2.0*random.uniform() - 1.0));
+            ptr++;
+        }
+    }
+    matrix->setRowPointer(spec.rows, ptr);
+    return matrix;
+}
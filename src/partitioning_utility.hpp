@@ -26,32 +26,326 @@ SOFTWARE.
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <memory>
 #include <random>
 
 #include "../include/includes.hpp"
 #include "../include/dense_vector.hpp"
 #include "../include/csr_matrix.hpp"
 #include "../include/index_value_pair.hpp"
+#include "performance_model.hpp"
+
+// Column bounds of the x partitions: partition j spans [xBounds[j], xBounds[j+1])
+static inline std::vector<int> ComputeUniformXPartitionBounds(
+    const int srcCols,
+    const int xParts) {
+
+    int xPartRem = static_cast<int>(srcCols) % xParts == 0 ? 0 : 1;
+    int xPartSize = static_cast<int>(srcCols) / xParts + xPartRem; // Size of x each partition
+
+    auto xBounds = std::vector<int>(xParts+1);
+    for (int j=0; j<xParts; j++) {
+        xBounds[j] = std::min(j*xPartSize, srcCols);
+    }
+    xBounds[xParts] = srcCols;
+    return xBounds;
+}
+
+// Per y partition (i.e. CU) block counts as streamed by the kernels after PackTilesIntoBuffers(),
+// estimated from the row assignment and x bounds without building the tiles. Each tile is priced in
+// the format ChooseTileFormat() gives it, as SelectTileFormats() does on the built tiles.
+struct PackingEstimate {
+    std::vector<uint> validTiles;
+    std::vector<uint> nnzBlocks; // Value blocks
+    std::vector<uint> colBlocks;
+    std::vector<uint> rowBlocks; // Row or slice entry blocks
+    std::vector<uint> vecBlocks;
+    std::vector<uint> rows;
+    std::vector<uint> nnz;
+    std::vector<uint> rowEntries; // Non-empty rows summed over the tiles
+    std::vector<uint> indexItems; // Index entries of the tiles' formats without padding, see TileShape
+    std::vector<uint> cols; // Distinct columns, i.e. x values needed
+
+    uint64_t streamedBytes(int part, uint blockSize) const { // nnz vals, cols, row entries, x and tile nnzs
+        uint tileBlocks = validTiles[part] ? ((validTiles[part]-1)/blockSize)+1 : 1;
+        return (uint64_t) (nnzBlocks[part] + colBlocks[part] + rowBlocks[part] + vecBlocks[part] + tileBlocks) 
+            * blockSize * sizeof(int);
+    }
+    uint64_t usefulBytes(int part) const { // The same without padding: nnz vals, index entries and needed x
+        return (uint64_t) (nnz[part] + indexItems[part] + cols[part]) * sizeof(int);
+    }
+    uint64_t streamedBytes(uint blockSize) const {
+        uint64_t bytes = 0;
+        for (int i=0; i<validTiles.size(); i++) {
+            bytes += streamedBytes(i, blockSize);
+        }
+        return bytes;
+    }
+};
 
 template <typename T> 
-static inline void PartitionMatrixIntoNnzBalancedYPartitionTiles(
+static inline PackingEstimate EstimatePackedBlocks(
+    const CSRMatrix<T> &source,
+    const std::vector<std::vector<int>> &yPartRows,
+    const std::vector<int> &xBounds,
+    const uint blockSize,
+    const uint tileFormats = 1 << TILE_FORMAT_CSR) {
+
+    int yParts = yPartRows.size();
+    int xParts = xBounds.size()-1;
+
+    // Each valid tile is padded to the widest x partition
+    uint maxVecBlocks = 0;
+    for (int j=0; j<xParts; j++) {
+        maxVecBlocks = std::max(maxVecBlocks, ((xBounds[j+1]-xBounds[j]-1)/blockSize)+1);
+    }
+
+    PackingEstimate estimate;
+    estimate.validTiles.resize(yParts);
+    estimate.nnzBlocks.resize(yParts);
+    estimate.colBlocks.resize(yParts);
+    estimate.rowBlocks.resize(yParts);
+    estimate.vecBlocks.resize(yParts);
+    estimate.rows.resize(yParts);
+    estimate.nnz.resize(yParts);
+    estimate.rowEntries.resize(yParts);
+    estimate.indexItems.resize(yParts);
+    estimate.cols.resize(yParts);
+
+    YPartitionTileShapes tileShapes(xBounds, blockSize);
+    auto colLastPart = std::vector<int>(source.cols(), -1);
+    for (int i=0; i<yParts; i++) {
+        tileShapes.measure(source, yPartRows[i]);
+        for (auto row : yPartRows[i]) {
+            for (int j=source.getRowPointer(row); j<source.getRowPointer(row+1); j++) {
+                auto col = source.getColIndex(j);
+                estimate.cols[i] += colLastPart[col] != i;
+                colLastPart[col] = i;
+            }
+        }
+        estimate.rows[i] = yPartRows[i].size();
+        for (auto &shape : tileShapes.shapes) {
+            if (!shape.nnz) continue;
+            int format = ChooseTileFormat(shape, tileFormats, blockSize);
+            estimate.nnz[i] += shape.nnz;
+            estimate.rowEntries[i] += shape.rows;
+            estimate.indexItems[i] += shape.indexItems(format);
+            estimate.validTiles[i]++;
+            estimate.nnzBlocks[i] += shape.valueBlocks(format, blockSize);
+            estimate.colBlocks[i] += shape.colBlocks(format, blockSize);
+            estimate.rowBlocks[i] += shape.entryBlocks(format, blockSize);
+            estimate.vecBlocks[i] += maxVecBlocks;
+        }
+    }
+    return estimate;
+}
+
+// Compares the streamed bytes of a packing against a reference packing (e.g. uniform x bounds)
+static inline void ReportPackingOverhead(
+    const PackingEstimate &estimate,
+    const PackingEstimate &reference,
+    const uint blockSize) {
+
+    uint64_t bytes = 0, refBytes = 0;
+    for (int i=0; i<estimate.validTiles.size(); i++) {
+        std::cout << "packing_overhead[" << i << "]: valid_tiles: " << estimate.validTiles[i] 
+            << " (ref. " << reference.validTiles[i] << ")"
+            << ", streamed_bytes: " << estimate.streamedBytes(i, blockSize) 
+            << " (ref. " << reference.streamedBytes(i, blockSize) << ")" << std::endl;
+        bytes += estimate.streamedBytes(i, blockSize);
+        refBytes += reference.streamedBytes(i, blockSize);
+    }
+    std::cout << "packing_overhead_streamed_bytes: " << bytes << std::endl;
+    std::cout << "packing_overhead_ref_streamed_bytes: " << refBytes << std::endl;
+    std::cout << "packing_overhead_saved_bytes: " << (int64_t) refBytes - (int64_t) bytes << std::endl;
+}
+
+// Per CU cost model: the kernels stream every block once, so a CU's run time follows its 
+// streamed blocks and the slowest CU bounds the run.
+static inline void ReportPartitionCost(
+    const PackingEstimate &estimate,
+    const uint blockSize) {
+
+    uint64_t maxBytes = 0, bytes = 0, usefulBytes = 0;
+    int parts = estimate.validTiles.size();
+    for (int i=0; i<parts; i++) {
+        std::cout << "partition_cost[" << i << "]: rows: " << estimate.rows[i] 
+            << ", nnz: " << estimate.nnz[i]
+            << ", valid_tiles: " << estimate.validTiles[i]
+            << ", nnz_blocks: " << estimate.nnzBlocks[i]
+            << ", col_blocks: " << estimate.colBlocks[i]
+            << ", row_blocks: " << estimate.rowBlocks[i]
+            << ", vec_blocks: " << estimate.vecBlocks[i]
+            << ", streamed_bytes: " << estimate.streamedBytes(i, blockSize)
+            << ", useful_bytes: " << estimate.usefulBytes(i) << std::endl;
+        maxBytes = std::max(maxBytes, estimate.streamedBytes(i, blockSize));
+        bytes += estimate.streamedBytes(i, blockSize);
+        usefulBytes += estimate.usefulBytes(i);
+    }
+    std::cout << "partition_cost_max_streamed_bytes: " << maxBytes << std::endl;
+    std::cout << "partition_cost_imbalance: " << (bytes ? maxBytes*parts/(double) bytes : 1.0) << std::endl;
+    std::cout << "partition_cost_padding_efficiency: " << (bytes ? usefulBytes/(double) bytes : 1.0) << std::endl;
+}
+
+// Per CU load and padding report as JSON: the slowest CU bounds the run (imbalance, max over mean), 
+// and the padding efficiency is the useful share of the streamed bytes
+static inline bool WritePartitionReportJson(
+    const std::string &reportFile,
+    const std::string &matrixFile,
+    const int partMethod,
+    const PackingEstimate &estimate,
+    const PipelineEstimate &pipeline,
+    const PerformanceModel &model,
+    const int iterations,
+    const double measuredUsec,
+    const uint blockSize) {
+
+    std::ofstream file(reportFile);
+    if (!file.good()) {
+        std::cout << "Error: can not write the report file: " << reportFile << std::endl;
+        return false;
+    }
+
+    std::string matrixName;
+    for (auto c : matrixFile) {
+        if (c == '"' || c == '\\') matrixName += '\\';
+        matrixName += c;
+    }
+
+    int parts = estimate.validTiles.size();
+    uint64_t bytes = 0, maxBytes = 0, usefulBytes = 0;
+    double cycles = 0, maxCycles = 0;
+
+    file << "{\n";
+    file << "  \"matrix\": \"" << matrixName << "\",\n";
+    file << "  \"part_method\": " << partMethod << ",\n";
+    file << "  \"iterations\": " << iterations << ",\n";
+    file << "  \"cus\": [\n";
+    for (int i=0; i<parts; i++) {
+        auto cuBytes = estimate.streamedBytes(i, blockSize);
+        auto cuCycles = pipeline.cycles(i, iterations);
+        bytes += cuBytes;
+        maxBytes = std::max(maxBytes, cuBytes);
+        usefulBytes += estimate.usefulBytes(i);
+        cycles += cuCycles;
+        maxCycles = std::max(maxCycles, cuCycles);
+
+        file << "    {\"cu\": " << i
+            << ", \"rows\": " << estimate.rows[i]
+            << ", \"nnz\": " << estimate.nnz[i]
+            << ", \"nnz_blocks\": " << estimate.nnzBlocks[i]
+            << ", \"padded_nnz\": " << estimate.nnzBlocks[i]*blockSize - estimate.nnz[i]
+            << ", \"col_blocks\": " << estimate.colBlocks[i]
+            << ", \"row_blocks\": " << estimate.rowBlocks[i]
+            << ", \"row_entries\": " << estimate.rowEntries[i]
+            << ", \"x_blocks\": " << estimate.vecBlocks[i]
+            << ", \"x_cols\": " << estimate.cols[i]
+            << ", \"valid_tiles\": " << estimate.validTiles[i]
+            << ", \"streamed_bytes\": " << cuBytes
+            << ", \"useful_bytes\": " << estimate.usefulBytes(i)
+            << ", \"padding_efficiency\": " << (cuBytes ? estimate.usefulBytes(i)/(double) cuBytes : 1.0)
+            << ", \"cycles\": " << (uint64_t) cuCycles
+            << ", \"bottleneck\": \"" << pipelineStageNames[pipeline.bottleneck(i)] << "\"}"
+            << (i+1 < parts ? "," : "") << "\n";
+    }
+    file << "  ],\n";
+    file << "  \"max_streamed_bytes\": " << maxBytes << ",\n";
+    file << "  \"imbalance_bytes\": " << (bytes ? maxBytes*parts/(double) bytes : 1.0) << ",\n";
+    file << "  \"imbalance_cycles\": " << (cycles ? maxCycles*parts/cycles : 1.0) << ",\n";
+    file << "  \"padding_efficiency\": " << (bytes ? usefulBytes/(double) bytes : 1.0) << ",\n";
+    file << "  \"predicted_kernel_time_usec\": " << pipeline.predictUsec(model, iterations) << ",\n";
+    file << "  \"kernel_running_time_usec\": " << measuredUsec << "\n";
+    file << "}\n";
+    return true;
+}
+
+// Variable-width x partitions from the column nnz histogram: a partition starts at the 
+// first non-empty column that is not yet covered and spans (at most) width columns. 
+// Runs of empty columns become empty partitions, which are never packed nor streamed.
+// For a given width this greedy cover is minimal in the number of non-empty partitions.
+static inline std::vector<int> CoverXPartitionBounds(
+    const std::vector<int> &colNnz,
+    const int width) {
+
+    int srcCols = colNnz.size();
+    auto xBounds = std::vector<int>(1, 0);
+    for (int col=0; col<srcCols; ) {
+        int end = std::min(col+width, srcCols);
+        if (colNnz[col] == 0) { // Empty partition up to the next non-empty column
+            for (end=col; end<srcCols && end-col<width && colNnz[end]==0; end++);
+        }
+        xBounds.push_back(end);
+        col = end;
+    }
+    return xBounds;
+}
+
+// Every valid tile is padded to the widest x partition, hence the narrowest width (in blocks) 
+// keeping the minimal count of non-empty partitions is searched for. The cheapest of it, the
+// full width cover and the uniform bounds by the estimated streamed bytes is selected.
+template <typename T> 
+static inline std::vector<int> ComputeAdaptiveXPartitionBounds(
     const CSRMatrix<T> &source,
-    const int srcRows,
     const int srcCols,
+    const int hwSideLen,
+    const std::vector<std::vector<int>> &yPartRows,
+    const uint blockSize,
+    const uint tileFormats = 1 << TILE_FORMAT_CSR) {
+
+    auto colNnz = std::vector<int>(srcCols, 0);
+    for (int i=0; i<source.nnz(); i++) {
+        colNnz[source.getColIndex(i)]++;
+    }
+
+    auto nonEmptyParts = [&colNnz](const std::vector<int> &xBounds) {
+        int parts = 0;
+        for (int j=0; j<xBounds.size()-1; j++) {
+            parts += std::any_of(colNnz.begin()+xBounds[j], colNnz.begin()+xBounds[j+1], [](int nnz){ return nnz > 0; });
+        }
+        return parts;
+    };
+
+    auto fullBounds = CoverXPartitionBounds(colNnz, hwSideLen);
+    int minParts = nonEmptyParts(fullBounds);
+
+    int lo = 1, hi = std::max(hwSideLen/(int)blockSize, 1); // In blocks
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+        nonEmptyParts(CoverXPartitionBounds(colNnz, mid*blockSize)) > minParts ? lo = mid+1 : hi = mid;
+    }
+    auto narrowBounds = CoverXPartitionBounds(colNnz, std::min((int) (lo*blockSize), hwSideLen));
+    auto uniformBounds = ComputeUniformXPartitionBounds(srcCols, std::ceil(srcCols/(double)hwSideLen));
+
+    auto streamedBytes = [&](const std::vector<int> &xBounds) {
+        return EstimatePackedBlocks(source, yPartRows, xBounds, blockSize, tileFormats).streamedBytes(blockSize);
+    };
+
+    auto best = uniformBounds;
+    auto bestBytes = streamedBytes(uniformBounds);
+    for (auto candidate : {narrowBounds, fullBounds}) {
+        auto bytes = streamedBytes(candidate);
+        if (bytes < bestBytes) {
+            best = candidate;
+            bestBytes = bytes;
+        }
+    }
+    return best;
+}
+
+// Sorts the rows by nnz and deals them in a serpentine order across the y partitions
+template <typename T> 
+static inline void AssignNnzBalancedYPartitionRows(
+    const CSRMatrix<T> &source,
+    const int srcRows,
     const int yParts, 
-    const int xParts,
-    std::vector<std::vector<CSRMatrix<T>*>> &tiles,
     std::vector<std::vector<int>> &yPartRows) { 
     
     // std::cout<< "srcRows: " << srcRows << std::endl;
 
-    int xPartRem = static_cast<int>(srcCols) % xParts == 0 ? 0 : 1;
-    int xPartSize = static_cast<int>(srcCols) / xParts + xPartRem; // Size of x each partition
-
-    std::cout<< "xParts:" << xParts << std::endl;
-    std::cout<< "xPartSize:" << xPartSize << std::endl;
-
     auto nnzBlocks = std::vector<std::pair<int, int>>(srcRows);
     for (int i=0; i<nnzBlocks.size(); i++) {
         nnzBlocks[i].first = (source.getRowPointer(i+1) - source.getRowPointer(i));
@@ -102,7 +396,299 @@ static inline void PartitionMatrixIntoNnzBalancedYPartitionTiles(
     //         yPartRows[i][j] = yPartRows_sorted[i][j].second;
     //     }
     // }
+}
+
+// Row assignment grouping rows with similar column footprints (the set of hwSideLen wide 
+// x tiles they touch) onto the same y partition. Rows are ordered by a MinHash signature of 
+// their footprint, so that rows sharing tiles are likely adjacent, and the order is then cut 
+// into yParts contiguous chunks. Each chunk is bounded by a cost cap on its estimated streamed 
+// words (nnz cols and values, a row entry per touched tile, and x of every touched tile), and the 
+// smallest cap that fits all rows is binary searched. The row count per chunk is capped to keep 
+// the y partition size of the balanced assignment.
+template <typename T> 
+static inline void AssignFootprintGroupedYPartitionRows(
+    const CSRMatrix<T> &source,
+    const int srcRows,
+    const int srcCols,
+    const int yParts,
+    const int hwSideLen,
+    const uint blockSize,
+    std::vector<std::vector<int>> &yPartRows) {
+
+    int xParts = std::ceil(srcCols/(double)hwSideLen);
+    int rowCap = std::min(hwSideLen, (int) ((std::ceil(srcRows/(double)yParts)/blockSize)+1)*(int)blockSize-1);
+    rowCap = std::max(rowCap, (int) std::ceil(srcRows/(double)yParts));
+    uint64_t tileWords = (((hwSideLen-1)/blockSize)+1)*blockSize + blockSize; // x and the end entry block
+
+    // MinHash signature over the touched tiles, two multiply-shift hashes per row
+    auto hash = [](uint64_t tile, uint64_t seed) { return (uint32_t) (((tile+1)*seed) >> 32); };
+    auto rowKeys = std::vector<std::pair<uint64_t, int>>(srcRows);
+    for (int row=0; row<srcRows; row++) {
+        uint32_t min1 = UINT32_MAX, min2 = UINT32_MAX;
+        for (int j=source.getRowPointer(row); j<source.getRowPointer(row+1); j++) {
+            uint64_t tile = source.getColIndex(j)/hwSideLen;
+            min1 = std::min(min1, hash(tile, 0x9E3779B97F4A7C15ull));
+            min2 = std::min(min2, hash(tile, 0xC2B2AE3D27D4EB4Full));
+        }
+        rowKeys[row] = {((uint64_t) min1 << 32) | min2, row};
+    }
+    std::stable_sort(rowKeys.begin(), rowKeys.end(), [](auto &left, auto &right) {
+        return left.first < right.first;
+    });
+
+    // Greedy contiguous chunking under a cost cap, returns the chunk start offsets
+    auto tileSeen = std::vector<int>(xParts, -1);
+    auto tileVisit = std::vector<uint64_t>(xParts, 0);
+    uint64_t visit = 0;
+    auto chunk = [&](uint64_t costCap) {
+        auto starts = std::vector<int>(1, 0);
+        std::fill(tileSeen.begin(), tileSeen.end(), -1);
+        uint64_t cost = 0;
+        for (int k=0; k<srcRows; k++) {
+            int row = rowKeys[k].second;
+            int part = starts.size()-1;
+            visit++;
+            uint64_t rowCost = 0; // Added words
+            for (int j=source.getRowPointer(row); j<source.getRowPointer(row+1); j++) {
+                int tile = source.getColIndex(j)/hwSideLen;
+                if (tileSeen[tile] != part) {
+                    tileSeen[tile] = part;
+                    rowCost += tileWords;
+                }
+                rowCost += 2 + (tileVisit[tile] != visit); // col and value, row entry
+                tileVisit[tile] = visit;
+            }
+            if (k > starts.back() && (cost+rowCost > costCap || k-starts.back() >= rowCap)) {
+                starts.push_back(k);
+                cost = 0;
+                k--; // Recount the row's tiles for the new chunk
+                continue;
+            }
+            cost += rowCost;
+        }
+        return starts;
+    };
+
+    uint64_t low = 0, high = 0; // Every row alone in its tiles is an upper bound
+    for (int row=0; row<srcRows; row++) {
+        high += 3*(source.getRowPointer(row+1)-source.getRowPointer(row)) + tileWords*std::min(xParts, 
+            source.getRowPointer(row+1)-source.getRowPointer(row)) + 1;
+    }
+    while (low < high) {
+        auto mid = low + (high-low)/2;
+        if (chunk(mid).size() <= yParts) {
+            high = mid;
+        } else {
+            low = mid+1;
+        }
+    }
+
+    auto starts = chunk(high);
+    starts.push_back(srcRows);
+    for (int i=0; i+1<starts.size(); i++) {
+        for (int k=starts[i]; k<starts[i+1]; k++) {
+            yPartRows[i].push_back(rowKeys[k].second);
+        }
+    }
+}
 
+// Column order grouping the columns by the set of y partitions having nnz in them, so that 
+// each partition's columns are gathered in fewer and denser tiles. Columns shared by more 
+// partitions come first, then (e.g. partition private) columns grouped by their first partition.
+// Empty columns end up last, and are left in empty tiles. Returns packed column -> matrix column.
+template <typename T> 
+static inline std::vector<int> ComputeColumnPermutation(
+    const CSRMatrix<T> &source,
+    const int srcCols,
+    const std::vector<std::vector<int>> &yPartRows) {
+
+    int yParts = yPartRows.size();
+    int words = (yParts+63)/64;
+    auto colParts = std::vector<uint64_t>(srcCols*words, 0); // Bit set of partitions per column
+    for (int i=0; i<yParts; i++) {
+        for (auto row : yPartRows[i]) {
+            for (int j=source.getRowPointer(row); j<source.getRowPointer(row+1); j++) {
+                colParts[source.getColIndex(j)*words+i/64] |= 1ull << (i%64);
+            }
+        }
+    }
+
+    auto colPartCount = std::vector<int>(srcCols, 0);
+    auto colFirstPart = std::vector<int>(srcCols, yParts);
+    for (int col=0; col<srcCols; col++) {
+        for (int w=words-1; w>=0; w--) {
+            auto bits = colParts[col*words+w];
+            colPartCount[col] += __builtin_popcountll(bits);
+            colFirstPart[col] = bits ? w*64+__builtin_ctzll(bits) : colFirstPart[col];
+        }
+    }
+
+    auto colPerm = std::vector<int>(srcCols);
+    std::iota(colPerm.begin(), colPerm.end(), 0);
+    std::stable_sort(colPerm.begin(), colPerm.end(), [&](int left, int right) {
+        if (colPartCount[left] != colPartCount[right]) return colPartCount[left] > colPartCount[right];
+        if (colFirstPart[left] != colFirstPart[right]) return colFirstPart[left] < colFirstPart[right];
+        return std::lexicographical_compare(colParts.begin()+left*words, colParts.begin()+(left+1)*words,
+            colParts.begin()+right*words, colParts.begin()+(right+1)*words);
+    });
+    return colPerm;
+}
+
+// Matrix with its columns reordered by colPerm (packed column -> matrix column)
+template <typename T> 
+static inline std::unique_ptr<CSRMatrix<T>> PermuteMatrixColumns(
+    const CSRMatrix<T> &source,
+    const std::vector<int> &colPerm) {
+
+    auto colInvPerm = std::vector<int>(colPerm.size());
+    for (int i=0; i<colPerm.size(); i++) {
+        colInvPerm[colPerm[i]] = i;
+    }
+
+    auto permuted = std::make_unique<CSRMatrix<T>>(source);
+    auto rowEntries = std::vector<std::pair<int, T>>();
+    for (int row=0; row<source.rows(); row++) { // Keeps the columns of each row sorted
+        rowEntries.clear();
+        for (int i=source.getRowPointer(row); i<source.getRowPointer(row+1); i++) {
+            rowEntries.push_back({colInvPerm[source.getColIndex(i)], source.getData(i)});
+        }
+        std::sort(rowEntries.begin(), rowEntries.end(), [](auto &left, auto &right) {
+            return left.first < right.first;
+        });
+        for (int i=source.getRowPointer(row), k=0; i<source.getRowPointer(row+1); i++, k++) {
+            permuted->setColIndex(i, rowEntries[k].first);
+            permuted->setData(i, rowEntries[k].second);
+        }
+    }
+    return permuted;
+}
+
+// Vector reordered by colPerm (packed column -> matrix column), i.e. x as the tiles expect it
+template <typename T> 
+static inline DenseVector<T> PermuteVector(
+    const DenseVector<T> &vec,
+    const std::vector<int> &colPerm) {
+
+    auto permuted = DenseVector<T>(vec.size());
+    for (int i=0; i<colPerm.size(); i++) {
+        permuted[i] = vec[colPerm[i]];
+    }
+    return permuted;
+}
+
+// Rows holding more than 1/SPLIT_ROW_SHARE of a y partition's average nnz are split into pieces
+// of consecutive columns, so that the row assignment deals them to different CUs
+#define SPLIT_ROW_SHARE 4
+
+// Matrix with the heavy rows split (see SPLIT_ROW_SHARE). Row i < source.rows() keeps the first
+// piece of row i, the further pieces follow as rows source.rows()+k, with splitRows[k] their
+// matrix row. The pieces' partial sums are added back by ReduceSplitRows(). The pieces are
+// capped to fit yParts*hwSideLen rows. Returns no matrix if no row is split.
+template <typename T>
+static inline std::unique_ptr<CSRMatrix<T>> SplitHeavyRows(
+    const CSRMatrix<T> &source,
+    const int yParts,
+    const int hwSideLen,
+    std::vector<int> &splitRows) {
+
+    splitRows.clear();
+    std::unique_ptr<CSRMatrix<T>> split;
+    if (yParts < 2) {
+        return split;
+    }
+
+    int pieceNnz = std::max((int) std::ceil(source.nnz()/(double) (yParts*SPLIT_ROW_SHARE)), 1);
+    auto heavyRows = std::vector<std::pair<int, int>>(); // nnz, row
+    for (int row=0; row<source.rows(); row++) {
+        int rowNnz = source.getRowPointer(row+1) - source.getRowPointer(row);
+        if (rowNnz > pieceNnz) {
+            heavyRows.push_back({rowNnz, row});
+        }
+    }
+    if (heavyRows.empty()) {
+        return split;
+    }
+
+    // Heaviest rows first, while the pieces fit the rows of the CUs
+    std::sort(heavyRows.begin(), heavyRows.end(), [](auto &left, auto &right) {
+        return left.first > right.first;
+    });
+    int64_t freeRows = (int64_t) yParts*hwSideLen - source.rows();
+    auto rowPieces = std::vector<int>(source.rows(), 1);
+    for (auto &heavy : heavyRows) {
+        int pieces = std::min((int64_t) (heavy.first+pieceNnz-1)/pieceNnz, freeRows+1);
+        rowPieces[heavy.second] = pieces;
+        freeRows -= pieces-1;
+    }
+
+    // Pieces of a row as near equal nnz ranges, the first in place of the row
+    auto pieceFirst = [&](int row, int piece) {
+        int first = source.getRowPointer(row), rowNnz = source.getRowPointer(row+1) - first;
+        return first + (int) ((int64_t) rowNnz*piece/rowPieces[row]);
+    };
+    for (int row=0; row<source.rows(); row++) {
+        for (int piece=1; piece<rowPieces[row]; piece++) {
+            splitRows.push_back(row);
+        }
+    }
+    if (splitRows.empty()) {
+        return split;
+    }
+
+    split = std::make_unique<CSRMatrix<T>>(source.nnz(), source.rows()+splitRows.size(), source.cols());
+    int ptr = 0;
+    auto copyPiece = [&](int splitRow, int row, int piece) {
+        split->setRowPointer(splitRow, ptr);
+        for (int i=pieceFirst(row, piece); i<pieceFirst(row, piece+1); i++, ptr++) {
+            split->setColIndex(ptr, source.getColIndex(i));
+            split->setData(ptr, source.getData(i));
+        }
+    };
+    for (int row=0; row<source.rows(); row++) {
+        copyPiece(row, row, 0);
+    }
+    for (int k=0, piece=1; k<splitRows.size(); k++, piece++) {
+        piece = k && splitRows[k] == splitRows[k-1] ? piece : 1;
+        copyPiece(source.rows()+k, splitRows[k], piece);
+    }
+    split->setRowPointer(split->rows(), ptr);
+    return split;
+}
+
+// Adds the split rows' partial sums (rows rows+k) onto their matrix rows, see SplitHeavyRows()
+template <typename T>
+static inline void ReduceSplitRows(
+    DenseVector<T> &vec,
+    const int rows,
+    const std::vector<int> &splitRows) {
+
+    for (int k=0; k<splitRows.size(); k++) {
+        vec[splitRows[k]] += vec[rows+k];
+        vec[rows+k] = 0;
+    }
+}
+
+// Splits each y partition's rows into CSR tiles along the x partition bounds
+template <typename T> 
+static inline void PartitionMatrixIntoYPartitionTiles(
+    const CSRMatrix<T> &source,
+    const int srcCols,
+    const std::vector<int> &xBounds,
+    const std::vector<std::vector<int>> &yPartRows,
+    std::vector<std::vector<CSRMatrix<T>*>> &tiles) { 
+
+    int yParts = yPartRows.size();
+    int xParts = xBounds.size()-1;
+
+    std::cout<< "xParts:" << xParts << std::endl;
+
+    auto yPartNnz = std::vector<int>(yParts);
+    for (int i=0; i<yParts; i++) {
+        for (auto row : yPartRows[i]) {
+            yPartNnz[i] += source.getRowPointer(row+1) - source.getRowPointer(row);
+        }
+        tiles[i].reserve(xParts);
+    }
 
     for (int i=0; i<yParts; i++) {
         // Populate the CSC matrix according to rows ids
@@ -168,9 +754,8 @@ static inline void PartitionMatrixIntoNnzBalancedYPartitionTiles(
 
         // Convert the CSC partition to CSR tiles
         for (int j=0; j<xParts; j++) {
-            int xPartStart = j*xPartSize; // Inclusive
-            int xPartEnd = xPartStart + xPartSize; // Exclusive
-            if (j == xParts-1) { xPartEnd -= (xPartEnd - srcCols); }
+            int xPartStart = xBounds[j]; // Inclusive
+            int xPartEnd = xBounds[j+1]; // Exclusive
 
             auto xFirst = cscPart.getColPointer(xPartStart);
             auto xLast = cscPart.getColPointer(xPartEnd);
@@ -222,23 +807,113 @@ static inline void PartitionMatrixIntoNnzBalancedYPartitionTiles(
 
 }
 
+template <typename T> 
+static inline void PartitionMatrixIntoNnzBalancedYPartitionTiles(
+    const CSRMatrix<T> &source,
+    const int srcRows,
+    const int srcCols,
+    const int yParts, 
+    const std::vector<int> &xBounds,
+    std::vector<std::vector<CSRMatrix<T>*>> &tiles,
+    std::vector<std::vector<int>> &yPartRows) { 
+
+    AssignNnzBalancedYPartitionRows(source, srcRows, yParts, yPartRows);
+    PartitionMatrixIntoYPartitionTiles(source, srcCols, xBounds, yPartRows, tiles);
+}
+
+// Row assignment, x bounds and, for method 3, the column permutation of a partitioning method, 
+// without building the tiles. The tiles follow from PartitionMatrixIntoYPartitionTiles() on 
+// matPerm, if set, else on source. Returns false for an unknown method.
+template <typename T> 
+static inline bool PlanMatrixPartitioning(
+    const CSRMatrix<T> &source,
+    const int partMethod,
+    const int yParts,
+    const int hwSideLen,
+    const uint blockSize,
+    std::vector<std::vector<int>> &yPartRows,
+    std::vector<int> &xBounds,
+    std::vector<int> &colPerm,
+    std::unique_ptr<CSRMatrix<T>> &matPerm,
+    const bool report,
+    const uint tileFormats = 1 << TILE_FORMAT_CSR) { // Of the xclbin, for the tiles' cost
+
+    yPartRows = std::vector<std::vector<int>>(yParts);
+    colPerm.clear();
+    matPerm.reset();
+
+    switch (partMethod) { // TODO: Enum conversion here and other places
+        case 2: // Row-shuffle for balanced nnz per y_partition tiling
+            AssignNnzBalancedYPartitionRows(source, source.rows(), yParts, yPartRows);
+            xBounds = ComputeUniformXPartitionBounds(source.cols(), std::ceil(source.cols()/(double)hwSideLen));
+            break;
+        case 3: // Row-shuffle for balanced nnz per y_partition and col-shuffle for denser tiling
+            AssignNnzBalancedYPartitionRows(source, source.rows(), yParts, yPartRows);
+            colPerm = ComputeColumnPermutation(source, source.cols(), yPartRows);
+            matPerm = PermuteMatrixColumns(source, colPerm);
+            xBounds = ComputeAdaptiveXPartitionBounds(*matPerm, source.cols(), hwSideLen, yPartRows, blockSize, tileFormats);
+            { // Keep the original column order unless the shuffle streams fewer bytes
+                auto xBoundsOrig = ComputeAdaptiveXPartitionBounds(source, source.cols(), hwSideLen, yPartRows, 
+                    blockSize, tileFormats);
+                if (EstimatePackedBlocks(source, yPartRows, xBoundsOrig, blockSize, tileFormats).streamedBytes(blockSize) <= 
+                    EstimatePackedBlocks(*matPerm, yPartRows, xBounds, blockSize, tileFormats).streamedBytes(blockSize)) {
+                    colPerm.clear();
+                    matPerm.reset();
+                    xBounds = xBoundsOrig;
+                }
+            }
+            if (report) {
+                std::cout << "col_shuffle: " << !colPerm.empty() << std::endl;
+            }
+            break;
+        case 4: // Row-shuffle for balanced nnz per y_partition and adaptive x bounds tiling
+            AssignNnzBalancedYPartitionRows(source, source.rows(), yParts, yPartRows);
+            xBounds = ComputeAdaptiveXPartitionBounds(source, source.cols(), hwSideLen, yPartRows, blockSize, tileFormats);
+            break;
+        case 5: // Rows grouped by column footprint, balanced streamed blocks per y_partition
+            AssignFootprintGroupedYPartitionRows(source, source.rows(), source.cols(), yParts, 
+                hwSideLen, blockSize, yPartRows);
+            { // Keep the nnz balanced rows unless the grouping lowers the slowest CU's modelled cycles
+                auto yPartRowsBalanced = std::vector<std::vector<int>>(yParts);
+                AssignNnzBalancedYPartitionRows(source, source.rows(), yParts, yPartRowsBalanced);
+                auto maxCycles = [&](const std::vector<std::vector<int>> &partRows) {
+                    auto bounds = ComputeAdaptiveXPartitionBounds(source, source.cols(), hwSideLen, partRows, 
+                        blockSize, tileFormats);
+                    return ModelPipelineCycles(source, partRows, bounds, blockSize, PerformanceModel(), tileFormats).maxCycles(1);
+                };
+                bool grouped = maxCycles(yPartRows) < maxCycles(yPartRowsBalanced);
+                if (!grouped) {
+                    yPartRows = yPartRowsBalanced;
+                }
+                if (report) {
+                    std::cout << "row_grouping: " << grouped << std::endl;
+                }
+            }
+            xBounds = ComputeAdaptiveXPartitionBounds(source, source.cols(), hwSideLen, yPartRows, blockSize, tileFormats);
+            break;
+        default: 
+            return false;
+    }
+    return true;
+}
+
 template<typename T> 
 void TiledMatrixVectorMult(
         std::vector<std::vector<CSRMatrix<T>*>> &tiles,
         const int yParts, 
-        const int xParts,
+        const std::vector<int> &xBounds,
         const DenseVector<T> &vec,
         DenseVector<T> &vecResComb,
         const std::vector<std::vector<int>> &yPartRows,
         const int part_method) {
     
+    int xParts = xBounds.size()-1;
     auto vecParts = std::vector<DenseVector<T>*>();
     vecParts.reserve(xParts);
     for (int i=0; i<xParts; i++) {
         auto vecPart = new DenseVector<T>(tiles[0][i]->cols());
-        // Offset determined by cols in the first tile
-        std::copy(vec.elements.get()+tiles[0][0]->cols()*i, 
-            vec.elements.get()+tiles[0][0]->cols()*i+vecPart->size(), vecPart->elements.get());
+        std::copy(vec.elements.get()+xBounds[i], 
+            vec.elements.get()+xBounds[i]+vecPart->size(), vecPart->elements.get());
         vecParts.push_back(vecPart);
     }
 
@@ -272,13 +947,14 @@ template<typename T>
 void verfiyTilePartitioningSpmv(
         const CSRMatrix<T> &matA,
         const int yParts, 
-        const int xParts,
+        const std::vector<int> &xBounds,
         const double iota,
         std::vector<std::vector<CSRMatrix<T>*>> &tiles, 
         std::vector<std::vector<int>> &yPartRows,
         int part_method) {
 
-    auto vec = DenseVector<T>(matA.rows());
+    int xParts = xBounds.size()-1;
+    auto vec = DenseVector<T>(matA.cols());
     std::iota(vec.elements.get(), vec.elements.get()+vec.size(), iota);
 
     std::ofstream myfile;
@@ -290,9 +966,8 @@ void verfiyTilePartitioningSpmv(
     vecParts.reserve(xParts);
     for (int i=0; i<xParts; i++) {
         auto vecPart = new DenseVector<T>(tiles[0][i]->cols());
-        // Offset determined by cols in the first tile
-        std::copy(vec.elements.get()+tiles[0][0]->cols()*i, 
-            vec.elements.get()+tiles[0][0]->cols()*i+vecPart->size(), vecPart->elements.get());
+        std::copy(vec.elements.get()+xBounds[i], 
+            vec.elements.get()+xBounds[i]+vecPart->size(), vecPart->elements.get());
         vecParts.push_back(vecPart);
 
         // auto name = "vecParts_" + std::to_string(i) + ".txt";
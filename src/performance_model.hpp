@@ -0,0 +1,252 @@
+/*
+MIT License
+
+Copyright (c) 2024 Abdul Rehman Tareen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "../include/includes.hpp"
+#include "../include/csr_matrix.hpp"
+#include "tile_formats.hpp"
+
+// Cycle-approximate model of the four kernel pipeline of a CU (see src/kernels). The kernels of
+// a CU run as a dataflow, so an iteration takes as long as its slowest streaming stage. On top
+// come the serial res_clear of the previous iteration's y blocks and, once per launch, res_write.
+
+// Streaming stages, in dataflow order
+enum PipelineStage {
+    STAGE_READ_INDICES = 0, // k1: row entries, nnz cols and tile descriptors
+    STAGE_READ_VALUES,      // k1: nnz values
+    STAGE_READ_VECTOR,      // k1: x segments
+    STAGE_READ_ROWS,        // k2: a row entry per cycle
+    STAGE_MULT_VALUES,      // k2: vec_read, out_rows and values_mult_blocked
+    STAGE_ROW_MARKING,      // k3: a row piece per block per cycle
+    STAGE_ROW_SUM,          // k3
+    STAGE_ROW_ACCUM,        // k4
+    STAGE_LOC_WRITE,        // k4: a row per cycle
+    STAGE_COUNT
+};
+
+static const char* pipelineStageNames[STAGE_COUNT] = {"read_indices", "read_values", "read_vector",
+    "read_rows", "values_mult_blocked", "row_marking", "row_sum", "row_accum", "loc_write"};
+
+// Model parameters, overridden per xclbin from a "<xclbin>.model" file of "<key> <value>" lines,
+// calibrated from measured kernel times
+struct PerformanceModel {
+    double frequencyMHz = 225.0; // kernel_frequency of the link config
+    double pipelineDepth = 12.0; // Fill and drain of an inner pipelined loop, paid per tile
+    double vecReadII = 1.0; // x block reads (II=4 before the ping-pong x buffer)
+    double launchUsec = 10.0; // Per launch of all the CUs
+    double cycleScale = 1.0; // Measured over modelled cycles
+    bool calibrated = false;
+};
+
+static inline PerformanceModel ReadPerformanceModel(const std::string &modelFile) {
+    PerformanceModel model;
+    std::ifstream file(modelFile);
+    std::string line, key;
+    double value;
+    while (std::getline(file, line)) {
+        std::stringstream ss(line.substr(0, line.find('#')));
+        if (!(ss >> key >> value)) continue;
+        if (key == "frequency_mhz") model.frequencyMHz = value;
+        else if (key == "pipeline_depth") model.pipelineDepth = value;
+        else if (key == "vec_read_ii") model.vecReadII = value;
+        else if (key == "launch_usec") model.launchUsec = value;
+        else if (key == "cycle_scale") model.cycleScale = value;
+        else continue;
+        model.calibrated = true;
+    }
+    return model;
+}
+
+// Modelled cycles per CU
+struct PipelineEstimate {
+    std::vector<std::array<double, STAGE_COUNT>> stageCycles; // Per iteration
+    std::vector<double> resClear; // Per iteration after the first
+    std::vector<double> resWrite; // Per launch
+
+    int bottleneck(int cu) const {
+        return std::max_element(stageCycles[cu].begin(), stageCycles[cu].end()) - stageCycles[cu].begin();
+    }
+
+    double cycles(int cu, int iterations) const {
+        return iterations * stageCycles[cu][bottleneck(cu)] + (iterations-1) * resClear[cu] + resWrite[cu];
+    }
+
+    double maxCycles(int iterations) const {
+        double max = 0;
+        for (int i=0; i<stageCycles.size(); i++) {
+            max = std::max(max, cycles(i, iterations));
+        }
+        return max;
+    }
+
+    double predictUsec(const PerformanceModel &model, int iterations) const {
+        return model.launchUsec + model.cycleScale * maxCycles(iterations) / model.frequencyMHz;
+    }
+};
+
+// Walks the tiles each CU would get from the row assignment and x bounds, in the order the kernels
+// stream them, and counts the trips of every stage's pipelined loops. Each tile takes the cheapest
+// of the given tile formats (a bit per format), as SelectTileFormats() does on the built tiles.
+template <typename T>
+static inline PipelineEstimate ModelPipelineCycles(
+    const CSRMatrix<T> &source,
+    const std::vector<std::vector<int>> &yPartRows,
+    const std::vector<int> &xBounds,
+    const uint blockSize,
+    const PerformanceModel &model,
+    const uint tileFormats = 1 << TILE_FORMAT_CSR) {
+
+    int yParts = yPartRows.size();
+    int xParts = xBounds.size()-1;
+    double depth = model.pipelineDepth;
+
+    uint vecBlocks = 0; // Each valid tile is padded to the widest x partition
+    for (int j=0; j<xParts; j++) {
+        vecBlocks = std::max(vecBlocks, ((xBounds[j+1]-xBounds[j]-1)/blockSize)+1);
+    }
+
+    PipelineEstimate estimate;
+    estimate.stageCycles.resize(yParts);
+    estimate.resClear.resize(yParts);
+    estimate.resWrite.resize(yParts);
+
+    YPartitionTileShapes tileShapes(xBounds, blockSize);
+    for (int i=0; i<yParts; i++) {
+        tileShapes.measure(source, yPartRows[i]);
+
+        auto &stages = estimate.stageCycles[i];
+        stages.fill(0);
+        uint validTiles = 0, nnzBlocks = 0, colBlocks = 0, rowBlocks = 0, lastNnzBlocks = 0;
+        for (int j=0; j<xParts; j++) {
+            auto &shape = tileShapes.shapes[j];
+            if (!shape.nnz) continue;
+            int format = ChooseTileFormat(shape, tileFormats, blockSize);
+            uint tileNnzBlocks = shape.valueBlocks(format, blockSize);
+            uint tileRowBlocks = shape.entryBlocks(format, blockSize); // Row (slice) entries and the end entry
+            uint rowDecodes = shape.rowDecodes(format, blockSize);
+            uint rowItems = shape.rowItems(format, blockSize);
+            uint rowPieces = shape.rowPieces(format, blockSize);
+            validTiles++;
+            lastNnzBlocks = tileNnzBlocks;
+            nnzBlocks += tileNnzBlocks;
+            colBlocks += shape.colBlocks(format, blockSize);
+            rowBlocks += tileRowBlocks;
+
+            stages[STAGE_READ_ROWS] += rowDecodes+1 + depth;
+            stages[STAGE_MULT_VALUES] += tileRowBlocks + depth // out_rows
+                + std::max((double) tileNnzBlocks, vecBlocks*model.vecReadII) + depth; // values_mult_blocked, loads the next x
+            stages[STAGE_ROW_MARKING] += rowPieces+1 + depth;
+            stages[STAGE_ROW_SUM] += rowPieces+1 + depth;
+            stages[STAGE_ROW_ACCUM] += rowPieces+1 + depth;
+            stages[STAGE_LOC_WRITE] += rowItems+1 + depth;
+        }
+        uint tileBlocks = validTiles ? ((validTiles-1)/blockSize)+1 : 1;
+        stages[STAGE_READ_INDICES] = rowBlocks + colBlocks + tileBlocks + depth;
+        stages[STAGE_READ_VALUES] = nnzBlocks + depth;
+        stages[STAGE_READ_VECTOR] = validTiles*vecBlocks*model.vecReadII + depth;
+        stages[STAGE_MULT_VALUES] += vecBlocks*model.vecReadII + depth; // vec_read of the first segment
+        if (validTiles) { // No next segment after the last tile
+            stages[STAGE_MULT_VALUES] -= std::max((double) lastNnzBlocks, vecBlocks*model.vecReadII) - lastNnzBlocks;
+        }
+
+        estimate.resClear[i] = tileShapes.dirtyBlocks + depth;
+        estimate.resWrite[i] = (yPartRows[i].size()/blockSize)+1 + depth;
+    }
+    return estimate;
+}
+
+static inline void ReportPipelineModel(
+    const PipelineEstimate &estimate,
+    const PerformanceModel &model,
+    const int iterations) {
+
+    for (int i=0; i<estimate.stageCycles.size(); i++) {
+        std::cout << "perf_model[" << i << "]:";
+        for (int s=0; s<STAGE_COUNT; s++) {
+            std::cout << " " << pipelineStageNames[s] << ": " << (uint64_t) estimate.stageCycles[i][s] << ",";
+        }
+        std::cout << " res_clear: " << (uint64_t) estimate.resClear[i]
+            << ", res_write: " << (uint64_t) estimate.resWrite[i]
+            << ", bottleneck: " << pipelineStageNames[estimate.bottleneck(i)]
+            << ", cycles: " << (uint64_t) estimate.cycles(i, iterations) << std::endl;
+    }
+    std::cout << "perf_model_calibrated: " << model.calibrated << std::endl;
+    double cycles = 0;
+    for (int i=0; i<estimate.stageCycles.size(); i++) {
+        cycles += estimate.cycles(i, iterations);
+    }
+    std::cout << "perf_model_max_cycles: " << (uint64_t) estimate.maxCycles(iterations) << std::endl;
+    std::cout << "perf_model_imbalance: " 
+        << (cycles ? estimate.maxCycles(iterations)*estimate.stageCycles.size()/cycles : 1.0) << std::endl;
+    std::cout << "perf_model_predicted_kernel_time (µsec): " << estimate.predictUsec(model, iterations) << std::endl;
+}
+
+// U280 HBM2: 32 pseudo-channels of 14.375 GB/s (460 GB/s). A CU streams its indices from one and
+// its values, x and y from another (see the sp= lines of the link configs).
+#define HBM_CHANNELS 32
+#define HBM_CHANNEL_PEAK_GBS 14.375
+#define HBM_CHANNELS_PER_CU 2
+
+// Bytes moved between HBM and the CUs per launch. Useful bytes are what the tiles' formats can not
+// do without: a value per nnz, the format's index entries (see TileShape::indexItems) and the x values 
+// a CU needs once per iteration, y once per launch. Formats streaming fewer indices than CSR lower 
+// both counts. The rest of the streamed bytes is padding of partial blocks and slices, the end entries 
+// of each tile, the x segments re-read for each tile, tile descriptors and the counter blocks.
+struct TrafficBytes {
+    uint64_t useful = 0;
+    uint64_t streamed = 0;
+
+    int64_t wasted() const { return (int64_t) streamed - (int64_t) useful; } // Signed, not clamped: negative flags a miscount
+};
+
+static inline void ReportTrafficBandwidth(
+    const TrafficBytes &traffic,
+    const int computeUnits,
+    const double avgSec,
+    const double lowestSec) {
+
+    double peakGBs = std::min(computeUnits*HBM_CHANNELS_PER_CU, HBM_CHANNELS) * HBM_CHANNEL_PEAK_GBS;
+    double usefulGBs = traffic.useful / avgSec / 1e9;
+    double streamedGBs = traffic.streamed / avgSec / 1e9;
+
+    std::cout << "useful_bytes_per_run: " << traffic.useful << std::endl;
+    std::cout << "streamed_bytes_per_run: " << traffic.streamed << std::endl;
+    std::cout << "wasted_bytes_per_run: " << traffic.wasted() << std::endl;
+    std::cout << "useful_bandwidth (GB/Sec): " << usefulGBs << std::endl;
+    std::cout << "streamed_bandwidth (GB/Sec): " << streamedGBs << std::endl;
+    std::cout << "wasted_bandwidth (GB/Sec): " << traffic.wasted() / avgSec / 1e9 << std::endl;
+    std::cout << "highest_useful_bandwidth (GB/Sec): " << traffic.useful / lowestSec / 1e9 << std::endl;
+    std::cout << "hbm_peak_bandwidth (GB/Sec, " << computeUnits << " CUs): " << peakGBs << std::endl;
+    std::cout << "hbm_device_peak_bandwidth (GB/Sec): " << HBM_CHANNELS*HBM_CHANNEL_PEAK_GBS << std::endl;
+    std::cout << "roofline_useful (%): " << 100.0 * usefulGBs / peakGBs << std::endl;
+    std::cout << "roofline_streamed (%): " << 100.0 * streamedGBs / peakGBs << std::endl;
+}
@@ -0,0 +1,139 @@
+/*
+MIT License
+
+Copyright (c) 2024 Abdul Rehman Tareen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Wall time of the host phases. A phase timed more than once (e.g. per run) keeps every sample,
+// reported as min/median/p99 and total.
+
+class PhaseTimers {
+    private:
+        std::vector<std::pair<std::string, std::vector<double>>> phases_; // In the order first stopped, sec
+    public:
+        void add(const std::string &phase, const double seconds) {
+            auto found = std::find_if(phases_.begin(), phases_.end(),
+                [&phase](const std::pair<std::string, std::vector<double>> &p) { return p.first == phase; });
+            if (found == phases_.end()) {
+                phases_.emplace_back(phase, std::vector<double>());
+                found = phases_.end()-1;
+            }
+            found->second.push_back(seconds);
+        }
+
+        const std::vector<std::pair<std::string, std::vector<double>>>& phases() const { return phases_; }
+};
+
+// Times its phase until stop() or the end of the scope
+class PhaseTimer {
+    private:
+        PhaseTimers &timers_;
+        std::string phase_;
+        std::chrono::high_resolution_clock::time_point start_;
+        bool stopped_ = false;
+    public:
+        PhaseTimer(PhaseTimers &timers, const std::string &phase): timers_(timers), phase_(phase),
+            start_(std::chrono::high_resolution_clock::now()) { }
+
+        ~PhaseTimer() { stop(); }
+
+        double stop() { // sec
+            std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start_;
+            if (!stopped_) {
+                timers_.add(phase_, time.count());
+                stopped_ = true;
+            }
+            return time.count();
+        }
+};
+
+struct PhaseStats {
+    size_t samples;
+    double min, median, p99, max, total;
+};
+
+static inline PhaseStats ComputePhaseStats(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    PhaseStats stats = {samples.size(), samples.front(), 0, 0, samples.back(), 0};
+    auto n = samples.size();
+    stats.median = n%2 ? samples[n/2] : (samples[n/2-1]+samples[n/2])/2;
+    stats.p99 = samples[std::max((size_t) std::ceil(0.99*n), (size_t) 1)-1]; // Nearest rank
+    for (auto s : samples) stats.total += s;
+    return stats;
+}
+
+static inline void ReportPhaseTimers(const PhaseTimers &timers) {
+    for (auto &phase : timers.phases()) {
+        auto stats = ComputePhaseStats(phase.second);
+        std::cout << "host_phase[" << phase.first << "]: samples: " << stats.samples
+            << ", min (sec): " << stats.min << ", median (sec): " << stats.median
+            << ", p99 (sec): " << stats.p99 << ", total (sec): " << stats.total << std::endl;
+    }
+}
+
+// JSON if the file ends with ".json", CSV otherwise
+static inline bool WritePhaseTimers(const std::string &metricsFile, const PhaseTimers &timers) {
+    std::ofstream file(metricsFile);
+    if (!file.good()) {
+        std::cout << "Error: can not write the metrics file: " << metricsFile << std::endl;
+        return false;
+    }
+    bool json = metricsFile.size() >= 5 && metricsFile.compare(metricsFile.size()-5, 5, ".json") == 0;
+
+    file.precision(9);
+    if (json) {
+        file << "{\n  \"phases\": [\n";
+    } else {
+        file << "phase,samples,min_sec,median_sec,p99_sec,max_sec,total_sec\n";
+    }
+    for (int i=0; i<timers.phases().size(); i++) {
+        auto &phase = timers.phases()[i];
+        auto stats = ComputePhaseStats(phase.second);
+        if (json) {
+            file << "    {\"phase\": \"" << phase.first << "\", \"samples\": " << stats.samples
+                << ", \"min_sec\": " << stats.min << ", \"median_sec\": " << stats.median
+                << ", \"p99_sec\": " << stats.p99 << ", \"max_sec\": " << stats.max
+                << ", \"total_sec\": " << stats.total << ", \"samples_sec\": [";
+            for (int s=0; s<phase.second.size(); s++) {
+                file << (s ? ", " : "") << phase.second[s];
+            }
+            file << "]}" << (i+1 < timers.phases().size() ? "," : "") << "\n";
+        } else {
+            file << phase.first << "," << stats.samples << "," << stats.min << "," << stats.median << ","
+                << stats.p99 << "," << stats.max << "," << stats.total << "\n";
+        }
+    }
+    if (json) {
+        file << "  ]\n}\n";
+    }
+    return file.good();
+}
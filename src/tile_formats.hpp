@@ -0,0 +1,330 @@
+/*
+MIT License
+
+Copyright (c) 2024 Abdul Rehman Tareen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "../include/includes.hpp"
+#include "../include/csr_matrix.hpp"
+#include "kernels/xlx_interface.hpp"
+
+static const char* tileFormatNames[TILE_FORMAT_COUNT] = {"csr", "sell", "bcsr", "dia", "coo"};
+
+// A tile as counted by the kernels' per tile loops, for each format:
+//   CSR   a row entry per non-empty row, the nnz packed, a row_marking trip per row piece of a block
+//   SELL  a slice entry per non-empty slice of blockSize rows, padded to its longest row, and a
+//         product block per slice, i.e. blockSize row items for k3 and k4
+//   BCSR  SELL's slices, of the non-empty blockSize/BCSR_C x BCSR_C blocks with a column block per 
+//         blockSize of them
+//   DIA   SELL's slices, each as wide as the tile's diagonals (at most blockSize), and a single column 
+//         block of their offsets
+//   COO   a (row, column) index per nnz with no row crossing a block (rows of at most blockSize nnz), 
+//         the end entry alone in the row entries and blockSize read_rows trips per block
+struct TileShape {
+    uint nnz = 0;
+    uint rows = 0; // Non-empty rows
+    uint pieces = 0; // CSR row pieces
+    uint slices = 0; // Non-empty SELL slices
+    uint sliceBlocks = 0; // SELL slice widths summed
+    uint bcsrBlocks = 0; // Non-empty BCSR blocks
+    uint diagonals = 0; // Distinct diagonals, counted up to blockSize+1
+    uint cooBlocks = 0;
+    uint maxRowNnz = 0;
+
+    static bool sliced(int format) { 
+        return format == TILE_FORMAT_SELL || format == TILE_FORMAT_BCSR || format == TILE_FORMAT_DIA; 
+    }
+
+    bool fits(int format, uint blockSize) const {
+        return (format != TILE_FORMAT_DIA || diagonals <= blockSize) && (format != TILE_FORMAT_COO || maxRowNnz <= blockSize);
+    }
+    uint entryBlocks(int format, uint blockSize) const { // Row or slice entries and the end entry
+        return format == TILE_FORMAT_COO ? 1 : ((sliced(format) ? slices : rows)/blockSize)+1;
+    }
+    uint valueBlocks(int format, uint blockSize) const {
+        return format == TILE_FORMAT_SELL ? sliceBlocks : format == TILE_FORMAT_BCSR ? bcsrBlocks 
+            : format == TILE_FORMAT_DIA ? slices*diagonals : format == TILE_FORMAT_COO ? cooBlocks 
+            : nnz ? ((nnz-1)/blockSize)+1 : 0;
+    }
+    uint colBlocks(int format, uint blockSize) const {
+        return format == TILE_FORMAT_BCSR ? (bcsrBlocks ? ((bcsrBlocks-1)/blockSize)+1 : 0) 
+            : format == TILE_FORMAT_DIA ? 1 : valueBlocks(format, blockSize);
+    }
+    uint prodBlocks(int format, uint blockSize) const {
+        return sliced(format) ? slices : valueBlocks(format, blockSize);
+    }
+    uint rowDecodes(int format, uint blockSize) const { // read_rows trips
+        return format == TILE_FORMAT_COO ? cooBlocks*blockSize : rowItems(format, blockSize);
+    }
+    uint rowItems(int format, uint blockSize) const { // loc_write trips
+        return sliced(format) ? slices*blockSize : rows;
+    }
+    uint rowPieces(int format, uint blockSize) const { // row_marking, row_sum and row_accum trips
+        return sliced(format) ? slices*blockSize : format == TILE_FORMAT_COO ? rows : pieces;
+    }
+    uint indexItems(int format) const { // Row, slice, block and diagonal entries or columns without padding
+        return format == TILE_FORMAT_SELL ? slices+nnz : format == TILE_FORMAT_BCSR ? slices+bcsrBlocks 
+            : format == TILE_FORMAT_DIA ? slices+diagonals : format == TILE_FORMAT_COO ? nnz : rows+nnz;
+    }
+    uint streamedBlocks(int format, uint blockSize) const {
+        return entryBlocks(format, blockSize) + valueBlocks(format, blockSize) + colBlocks(format, blockSize);
+    }
+    uint cycles(int format, uint blockSize) const { // Of the tile's busiest kernel
+        return std::max(entryBlocks(format, blockSize) + std::max(valueBlocks(format, blockSize), colBlocks(format, blockSize)), 
+            std::max(rowPieces(format, blockSize), rowDecodes(format, blockSize))+1);
+    }
+
+    void addCooRow(uint rowNnz, uint &cooLanes, uint blockSize) { // Rows in order, cooLanes of the open block
+        if (cooLanes && cooLanes+rowNnz > blockSize) {
+            cooBlocks++;
+            cooLanes = 0;
+        }
+        cooLanes += rowNnz;
+        maxRowNnz = std::max(maxRowNnz, rowNnz);
+    }
+    void closeCoo(uint cooLanes) {
+        cooBlocks += cooLanes > 0;
+    }
+};
+
+// The (block row << ROW_ENTRY_SHIFT) | first column entries of the slice's non-empty BCSR blocks, in 
+// block row and then column order, block rows counted from the slice's first row
+template <typename T> 
+static inline void ListSliceBlocks(
+    const CSRMatrix<T> &tile,
+    const uint first,
+    const uint blockSize,
+    std::vector<int> &blocks) {
+
+    blocks.clear();
+    uint blockRows = blockSize/BCSR_C;
+    for (uint row=first; row<std::min(first+blockSize, (uint) tile.rows()); row++) {
+        for (int ind=tile.getRowPointer(row); ind<tile.getRowPointer(row+1); ind++) {
+            blocks.push_back(((row-first)/blockRows) << ROW_ENTRY_SHIFT | (tile.getColIndex(ind)/BCSR_C)*BCSR_C);
+        }
+    }
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+}
+
+// Adds the diagonal (col-row) to the distinct ones, unless more than the limit were found already
+static inline void AddDiagonal(
+    std::vector<int> &diagonals,
+    const int diagonal,
+    const uint limit) {
+
+    if (diagonals.size() <= limit && std::find(diagonals.begin(), diagonals.end(), diagonal) == diagonals.end()) {
+        diagonals.push_back(diagonal);
+    }
+}
+
+// The tile's distinct diagonals in ascending order, more than the limit if it has more
+template <typename T> 
+static inline void ListTileDiagonals(
+    const CSRMatrix<T> &tile,
+    const uint limit,
+    std::vector<int> &diagonals) {
+
+    diagonals.clear();
+    for (int row=0; row<tile.rows() && diagonals.size() <= limit; row++) {
+        for (int ind=tile.getRowPointer(row); ind<tile.getRowPointer(row+1); ind++) {
+            AddDiagonal(diagonals, tile.getColIndex(ind)-row, limit);
+        }
+    }
+    std::sort(diagonals.begin(), diagonals.end());
+}
+
+template <typename T> 
+static inline TileShape MeasureTileShape(
+    const CSRMatrix<T> &tile,
+    const uint blockSize) {
+
+    TileShape shape;
+    uint sliceWidth = 0, cooLanes = 0;
+    std::vector<int> blocks;
+    for (int row=0; row<tile.rows(); row++) {
+        uint rowNnz = tile.getRowPointer(row+1) - tile.getRowPointer(row);
+        if (row%blockSize == 0) {
+            shape.sliceBlocks += sliceWidth;
+            shape.slices += sliceWidth > 0;
+            sliceWidth = 0;
+            ListSliceBlocks(tile, row, blockSize, blocks);
+            shape.bcsrBlocks += blocks.size();
+        }
+        sliceWidth = std::max(sliceWidth, rowNnz);
+        if (!rowNnz) continue;
+        shape.addCooRow(rowNnz, cooLanes, blockSize);
+        shape.pieces += ((shape.nnz%blockSize)+rowNnz-1)/blockSize+1; // The row starts at the running nnz offset
+        shape.nnz += rowNnz;
+        shape.rows++;
+    }
+    shape.sliceBlocks += sliceWidth;
+    shape.slices += sliceWidth > 0;
+    ListTileDiagonals(tile, blockSize, blocks);
+    shape.diagonals = blocks.size();
+    shape.closeCoo(cooLanes);
+    return shape;
+}
+
+// The shapes of a y partition's (i.e. CU's) tiles from its rows, in local y order, and the x bounds,
+// without building the tiles, as MeasureTileShape() gives them. The buffers are kept across partitions.
+struct YPartitionTileShapes {
+    std::vector<TileShape> shapes; // Per x partition, empty tiles have no nnz
+    uint dirtyBlocks = 0; // y blocks with a row of nnz
+
+    const std::vector<int> &xBounds;
+    uint blockSize;
+    std::vector<uint> rowTileNnz;
+    std::vector<uint> tileCooLanes;
+    std::vector<int> tileSlice;
+    std::vector<uint> tileSliceWidth;
+    std::vector<std::vector<int>> tileDiagonals;
+    std::vector<uint> blockBase; // BCSR block columns of the tiles before
+    std::vector<int64_t> blockMark; // Last (partition, block row) of a block column
+    int64_t measured = 0;
+    std::vector<int> touched;
+
+    YPartitionTileShapes(const std::vector<int> &xBounds, const uint blockSize) : xBounds(xBounds), blockSize(blockSize) {
+        int xParts = xBounds.size()-1;
+        shapes.resize(xParts);
+        rowTileNnz.resize(xParts, 0);
+        tileCooLanes.resize(xParts);
+        tileSlice.resize(xParts);
+        tileSliceWidth.resize(xParts);
+        tileDiagonals.resize(xParts);
+        blockBase.resize(xParts+1, 0);
+        for (int j=0; j<xParts; j++) {
+            blockBase[j+1] = blockBase[j] + (xBounds[j+1]-xBounds[j]-1)/BCSR_C+1;
+        }
+        blockMark.resize(blockBase[xParts], -1);
+    }
+
+    template <typename T> 
+    void measure(const CSRMatrix<T> &source, const std::vector<int> &partRows) {
+        std::fill(shapes.begin(), shapes.end(), TileShape());
+        std::fill(tileCooLanes.begin(), tileCooLanes.end(), 0);
+        std::fill(tileSlice.begin(), tileSlice.end(), -1);
+        for (auto &diagonals : tileDiagonals) diagonals.clear();
+        dirtyBlocks = 0;
+        int lastDirtyBlock = -1;
+        uint blockRows = blockSize/BCSR_C;
+        measured++;
+
+        for (int r=0; r<partRows.size(); r++) {
+            int row = partRows[r];
+            touched.clear();
+            for (int j=source.getRowPointer(row); j<source.getRowPointer(row+1); j++) {
+                auto tile = std::upper_bound(xBounds.begin(), xBounds.end(), source.getColIndex(j)) - xBounds.begin() - 1;
+                if (!rowTileNnz[tile]++) touched.push_back(tile);
+                AddDiagonal(tileDiagonals[tile], source.getColIndex(j)-xBounds[tile]-r, blockSize);
+                auto &mark = blockMark[blockBase[tile] + (source.getColIndex(j)-xBounds[tile])/BCSR_C];
+                int64_t blockRow = measured << 32 | r/blockRows;
+                if (mark != blockRow) {
+                    mark = blockRow;
+                    shapes[tile].bcsrBlocks++;
+                }
+            }
+            for (auto tile : touched) { // The row's nnz start at the tile's running nnz offset
+                auto &shape = shapes[tile];
+                uint nnz = rowTileNnz[tile];
+                if (tileSlice[tile] != (int) (r/blockSize)) {
+                    tileSlice[tile] = r/blockSize;
+                    tileSliceWidth[tile] = 0;
+                    shape.slices++;
+                }
+                if (nnz > tileSliceWidth[tile]) {
+                    shape.sliceBlocks += nnz-tileSliceWidth[tile];
+                    tileSliceWidth[tile] = nnz;
+                }
+                shape.addCooRow(nnz, tileCooLanes[tile], blockSize);
+                shape.pieces += ((shape.nnz%blockSize)+nnz-1)/blockSize+1;
+                shape.nnz += nnz;
+                shape.rows++;
+                rowTileNnz[tile] = 0;
+            }
+            if (!touched.empty() && (int) (r/blockSize) != lastDirtyBlock) {
+                lastDirtyBlock = r/blockSize;
+                dirtyBlocks++;
+            }
+        }
+        for (int j=0; j<shapes.size(); j++) {
+            shapes[j].diagonals = tileDiagonals[j].size();
+            shapes[j].closeCoo(tileCooLanes[j]);
+        }
+    }
+};
+
+// Among the given formats (a bit per format), the one of the fewest streamed blocks whose cycles are 
+// within a cycle per blockSize of the fewest, so bandwidth is saved where the kernels keep pace. CSR,
+// then the fewer cycles on a tie.
+static inline int ChooseTileFormat(
+    const TileShape &shape,
+    const uint formats,
+    const uint blockSize) {
+
+    uint fewestCycles = shape.cycles(TILE_FORMAT_CSR, blockSize);
+    for (int format=0; format<TILE_FORMAT_COUNT; format++) {
+        if ((formats >> format & 1) && shape.fits(format, blockSize)) {
+            fewestCycles = std::min(fewestCycles, shape.cycles(format, blockSize));
+        }
+    }
+
+    int best = -1;
+    for (int format=0; format<TILE_FORMAT_COUNT; format++) {
+        if (!((formats >> format & 1) || format == TILE_FORMAT_CSR) || !shape.fits(format, blockSize)) continue;
+        uint cycles = shape.cycles(format, blockSize);
+        if ((uint64_t) cycles*blockSize > (uint64_t) fewestCycles*(blockSize+1)) continue;
+        if (best < 0 || shape.streamedBlocks(format, blockSize) < shape.streamedBlocks(best, blockSize) 
+                || (shape.streamedBlocks(format, blockSize) == shape.streamedBlocks(best, blockSize) 
+                    && cycles < shape.cycles(best, blockSize))) {
+            best = format;
+        }
+    }
+    return best;
+}
+
+template <typename T> 
+static inline std::vector<std::vector<int>> SelectTileFormats(
+    const std::vector<std::vector<CSRMatrix<T>*>> &tiles,
+    const uint formats,
+    const uint blockSize) {
+
+    auto tileFormats = std::vector<std::vector<int>>(tiles.size());
+    auto counts = std::vector<uint>(TILE_FORMAT_COUNT, 0);
+    for (int i=0; i<tiles.size(); i++) {
+        for (auto tile : tiles[i]) {
+            int format = tile->nnz() ? ChooseTileFormat(MeasureTileShape(*tile, blockSize), formats, blockSize) 
+                : TILE_FORMAT_CSR;
+            tileFormats[i].push_back(format);
+            counts[format] += tile->nnz() > 0;
+        }
+    }
+    for (int format=0; format<TILE_FORMAT_COUNT; format++) {
+        std::cout << "tile_format_count[" << tileFormatNames[format] << "]: " << counts[format] << std::endl;
+    }
+    return tileFormats;
+}
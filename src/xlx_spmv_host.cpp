@@ -32,6 +32,7 @@ SOFTWARE.
 #include <chrono>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <unistd.h>
 #include <random>    
 #include <fenv.h>
@@ -42,7 +43,10 @@ SOFTWARE.
 #include "../include/csr_matrix.hpp"
 #include "../include/csc_matrix.hpp"
 #include "../include/linear_algebra.hpp"
+#include "matrix_generator.hpp"
 #include "partitioning_utility.hpp"
+#include "performance_model.hpp"
+#include "phase_timer.hpp"
 #include "xrt_utility.hpp"
 #include "utility.hpp"
 
@@ -71,22 +75,25 @@ int RunHiHiSpMV(
         int runs, 
         int partMethod, 
         int verifiability, 
-        int verbosity) {
+        int verbosity,
+        std::string reportFile,
+        std::string metricsFile) {
     
+    PhaseTimers timers;
+
     // Start: Matrix parsing region
 
-    auto start = std::chrono::high_resolution_clock::now();
+    PhaseTimer parseTimer(timers, "parse_matrix");
     bool read;
-    auto matA = ReadMatrixCSR<T>(matrixFile, read);
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> time = end - start;
+    auto matA = IsGeneratedMatrix(matrixFile) ? GenerateMatrixCSR<T>(matrixFile, read) : ReadMatrixCSR<T>(matrixFile, read);
+    double time = parseTimer.stop();
 
     if (!read) {
         std::cout<< "Error: can not read the matrix file: " << matrixFile << std::endl;
         return EXIT_FAILURE;
     }
     
-    std::cout<< "parsing_matrix_time (sec): " << time.count() << std::endl;
+    std::cout<< "parsing_matrix_time (sec): " << time << std::endl;
     
     if (verbosity&1){
         std::cout << "matA->nnz(): " << matA->nnz() <<  std::endl;
@@ -96,58 +103,161 @@ int RunHiHiSpMV(
 
     // End: Matrix parsing region
 
-    // Start: Partitioning region
+    // Start: Device and xclbin selection
 
-    int yParts = computeUnits;
-    int xParts = std::ceil(matA->cols()/(double)hwSideLen);/*tiles_in_part*/;
+    // Several xclbin variants may be given comma-separated, the one with the lowest predicted 
+    // kernel time for a dry run of the partitioner is loaded
+    std::vector<std::string> binaryFiles;
+    std::stringstream binaryList(binaryFile);
+    for (std::string file; std::getline(binaryList, file, ',');) {
+        binaryFiles.push_back(file);
+    }
 
-    std::cout << "tilesInYPart: " << xParts <<  std::endl;
+    PhaseTimer selectionTimer(timers, "xclbin_selection");
 
-    if (hwSideLen < std::ceil(matA->rows()/(double)yParts)) {
-        std::cout<< "The hardware size: " << hwSideLen 
-            <<  " can not accomodate y_partition size: " << matA->rows()/yParts << std::endl;
-        return EXIT_FAILURE;
+    auto device = xrt::device(deviceIndex);
+    xrt::uuid uuid;
+    HardwareCaps caps;
+    PerformanceModel perfModel;
+    int selected = -1, loaded = -1;
+    double selectedUsec = 0;
+    const int reqComputeUnits = computeUnits, reqHwSideLen = hwSideLen;
+
+    for (int k=0; k<binaryFiles.size(); k++) {
+        uuid = device.load_xclbin(binaryFiles[k]);
+        loaded = k;
+
+        // CU count and HW size of 0 are taken from the xclbin, given ones must fit it
+        auto candCaps = ReadHardwareCaps(device, uuid, binaryFiles[k], BLOCK_SIZE, verbosity);
+        int candUnits = reqComputeUnits, candSideLen = reqHwSideLen;
+        if (!ResolveHardwareLimits(candCaps, BLOCK_SIZE, sizeof(T)*8, matA->rows(), candUnits, candSideLen)) {
+            continue;
+        }
+
+        auto candModel = ReadPerformanceModel(binaryFiles[k] + ".model");
+        double candUsec = 0;
+        if (binaryFiles.size() > 1) {
+            std::vector<std::vector<int>> candRows;
+            std::vector<int> candBounds, candPerm;
+            std::unique_ptr<CSRMatrix<T>> candMat;
+            std::vector<int> candSplit;
+            auto candSplitMat = SplitHeavyRows(*matA, candUnits, candSideLen, candSplit);
+            auto &candSource = candSplitMat ? *candSplitMat : *matA;
+            if (!PlanMatrixPartitioning(candSource, partMethod, candUnits, candSideLen, BLOCK_SIZE, 
+                    candRows, candBounds, candPerm, candMat, false, candCaps.tileFormats)) {
+                std::cout<< "Invalid partitioning method specified" << std::endl;
+                return EXIT_FAILURE;
+            }
+            auto candEstimate = ModelPipelineCycles(candMat ? *candMat : candSource, candRows, candBounds, BLOCK_SIZE, 
+                candModel, candCaps.tileFormats);
+            candUsec = candEstimate.predictUsec(candModel, iterations);
+            std::cout << "xclbin_candidate[" << k << "]: " << binaryFiles[k] 
+                << ", compute_units: " << candUnits
+                << ", hw_side_len: " << candSideLen
+                << ", model_calibrated: " << candModel.calibrated
+                << ", predicted_kernel_time (µsec): " << candUsec << std::endl;
+        }
+
+        if (selected < 0 || candUsec < selectedUsec) {
+            selected = k;
+            selectedUsec = candUsec;
+            caps = candCaps;
+            perfModel = candModel;
+            computeUnits = candUnits;
+            hwSideLen = candSideLen;
+        }
     }
 
-    // x is now as many times partitioned
-    if (hwSideLen < std::ceil(matA->cols()/xParts)) {
-        std::cout<< "The hardware size: " << hwSideLen 
-            <<  " can not accomodate x_partition size: " << matA->cols()/xParts << std::endl;
+    if (selected < 0) {
+        std::cout<< "None of the xclbins can run the matrix" << std::endl;
         return EXIT_FAILURE;
     }
+    if (loaded != selected) {
+        uuid = device.load_xclbin(binaryFiles[selected]);
+    }
+    binaryFile = binaryFiles[selected];
+
+    std::cout<< "xclbin_selection_time (sec): " << selectionTimer.stop() << std::endl;
 
-    start = std::chrono::high_resolution_clock::now();
+    std::cout << "selected_xclbin: " << binaryFile << std::endl;
+    std::cout << "computeUnits: " << computeUnits << std::endl;
+    std::cout << "hwSideLen: " << hwSideLen << std::endl;
+
+    // End: Device and xclbin selection
+
+    // Start: Partitioning region
+
+    int yParts = computeUnits;
+    int xParts;
+
+    PhaseTimer partitioningTimer(timers, "partitioning");
 
     std::vector<std::vector<CSRMatrix<T>*>> tiles(yParts);
-    for (int i=0; i<yParts; i++) {
-        tiles[i].reserve(xParts);
+    std::vector<std::vector<int>> yPartRows;
+    std::vector<int> xBounds; // x partition j spans the columns [xBounds[j], xBounds[j+1])
+    std::vector<int> colPerm; // Packed column -> matrix column, identity if empty
+    std::unique_ptr<CSRMatrix<T>> matPerm; // matRows with the packed column order
+    std::vector<int> splitRows; // Matrix row of the split rows' further pieces
+
+    // Heavy rows split into pieces, for the row assignment to spread them over the CUs
+    auto matSplit = SplitHeavyRows(*matA, yParts, hwSideLen, splitRows);
+    auto &matRows = matSplit ? *matSplit : *matA;
+    int splitRowCount = 0;
+    for (int k=0; k<splitRows.size(); k++) {
+        splitRowCount += !k || splitRows[k] != splitRows[k-1];
     }
+    std::cout << "split_rows: " << splitRowCount << std::endl;
+    std::cout << "split_row_pieces: " << splitRows.size() << std::endl;
 
-    auto yPartRows = std::vector<std::vector<int>>(yParts);
-    switch (partMethod) { // TODO: Enum conversion here and other places
-        case 2: // Row-shuffle for balanced nnz per y_partition tiling
-            PartitionMatrixIntoNnzBalancedYPartitionTiles(*matA, matA->rows(), matA->cols(),
-                yParts, xParts, tiles, yPartRows);
-            break;
-        default: std::cout<< "Invalid partitioning method specified" << std::endl;
-            return EXIT_FAILURE;
+    if (!PlanMatrixPartitioning(matRows, partMethod, yParts, hwSideLen, BLOCK_SIZE, 
+            yPartRows, xBounds, colPerm, matPerm, true, caps.tileFormats)) {
+        std::cout<< "Invalid partitioning method specified" << std::endl;
+        return EXIT_FAILURE;
     }
+    PartitionMatrixIntoYPartitionTiles(matPerm ? *matPerm : matRows, matA->cols(), xBounds, yPartRows, tiles);
+    xParts = xBounds.size()-1;
     
     // End: Partitioning region
 
-    end = std::chrono::high_resolution_clock::now();
-    time = end - start;
-    std::cout<< "partitioning_matrix_time (sec): " << time.count() << std::endl;
+    std::cout<< "partitioning_matrix_time (sec): " << partitioningTimer.stop() << std::endl;
+
+    std::cout << "tilesInYPart: " << xParts <<  std::endl;
+
+    // x partitions may vary in width now
+    for (int j=0; j<xParts; j++) {
+        if (hwSideLen < xBounds[j+1]-xBounds[j]) {
+            std::cout<< "The hardware size: " << hwSideLen 
+                <<  " can not accomodate x_partition size: " << xBounds[j+1]-xBounds[j] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    PhaseTimer costTimer(timers, "cost_model");
+    auto packingEstimate = EstimatePackedBlocks(matPerm ? *matPerm : matRows, yPartRows, xBounds, BLOCK_SIZE, 
+        caps.tileFormats);
+    if (partMethod >= 3) { // Bytes saved over the original column order and uniform x bounds
+        auto uniformBounds = ComputeUniformXPartitionBounds(matA->cols(), std::ceil(matA->cols()/(double)hwSideLen));
+        ReportPackingOverhead(packingEstimate, EstimatePackedBlocks(matRows, yPartRows, uniformBounds, BLOCK_SIZE, 
+            caps.tileFormats), BLOCK_SIZE);
+    }
+    ReportPartitionCost(packingEstimate, BLOCK_SIZE);
+
+    auto pipelineEstimate = ModelPipelineCycles(matPerm ? *matPerm : matRows, yPartRows, xBounds, BLOCK_SIZE, 
+        perfModel, caps.tileFormats);
+    ReportPipelineModel(pipelineEstimate, perfModel, iterations);
+    costTimer.stop();
     
     if (verifiability&2) {
-        verfiyTilePartitioningSpmv(*matA, yParts, xParts, 1, tiles, yPartRows, partMethod);
+        PhaseTimer verifyTimer(timers, "verify_partitioning");
+        verfiyTilePartitioningSpmv(matPerm ? *matPerm : matRows, yParts, xBounds, 1, tiles, yPartRows, partMethod);
     }
 
     // SpMV vectors
     auto vecX = DenseVector<T>(matA->cols()); // Ax=b
-    auto vecB = DenseVector<T>(matA->cols()); // Ax=b (fpga)
+    auto vecB = DenseVector<T>(matA->rows()+splitRows.size()); // Ax=b (fpga), then the split rows' pieces
     
     // std::unique_ptr<CSRMatrix<double>> matA_db = readMatrixCSR<double>(matrixFile, read);
+    PhaseTimer copyTimer(timers, "double_copy");
     CSRMatrix<double> matA_db(matA->nnz(), matA->rows(), matA->cols());
     for (int i=0; i<matA->nnz(); i++) {
         matA_db.setData(i, matA->getData(i));
@@ -157,7 +267,9 @@ int RunHiHiSpMV(
     for (int i=0; i<matA->rows(); i++){
         matA_db.setRowPointer(i, matA->getRowPointer(i));
     }
+    copyTimer.stop();
 
+    PhaseTimer vectorTimer(timers, "vector_init");
     float min = -10.0f;
     float max = 10.0f;
     srand(0);
@@ -167,20 +279,26 @@ int RunHiHiSpMV(
             return min + scale * (max-min);
         });
     
-    auto vecC = DenseVector<T>(matA->cols(), 0); // Ax=c (ref)
-    TiledMatrixVectorMult<T>(tiles, yParts, xParts, vecX, vecC, yPartRows, partMethod);
+    // x in the packed column order
+    auto vecXPacked = colPerm.empty() ? vecX : PermuteVector(vecX, colPerm);
+    vectorTimer.stop();
 
-    // Start: Device and kernels creation
-    auto device = xrt::device(deviceIndex);
-    auto uuid = device.load_xclbin(binaryFile);
+    auto vecC = DenseVector<T>(matA->rows()+splitRows.size(), 0); // Ax=c (ref), then the split rows' pieces
+    PhaseTimer referenceTimer(timers, "reference_spmv");
+    TiledMatrixVectorMult<T>(tiles, yParts, xBounds, vecXPacked, vecC, yPartRows, partMethod);
+    ReduceSplitRows(vecC, matA->rows(), splitRows);
+    referenceTimer.stop();
 
+    // Start: Device and kernels creation (device opened above)
     std::vector<xrt::kernel> spmvKrnl1(tiles.size()), 
                             spmvKrnl2(tiles.size()),
                             spmvKrnl3(tiles.size()), 
                             spmvKrnl4(tiles.size());
 
+    PhaseTimer kernelsTimer(timers, "kernel_creation");
     CreateKernels(spmvKrnl1, spmvKrnl2, spmvKrnl3, spmvKrnl4, 
         device, uuid, binaryFile, tiles.size(), verbosity);
+    kernelsTimer.stop();
 
     // End: Device and kernels creation
 
@@ -192,44 +310,68 @@ int RunHiHiSpMV(
     std::vector<xrt::bo> boIndices(tiles.size()),
                             boValues(tiles.size()); 
                             //  bo_nnz_blks(tiles.size());
-    std::vector<uint> validTiles;
-    validTiles.reserve(tiles.size());
-
-    AllocateBuffers(device, spmvKrnl1, boIndices, boValues, tiles, validTiles, BLOCK_SIZE);
 
-    // Each title's value count
-    std::vector<uint> nnzBlocksTot; 
-    nnzBlocksTot.reserve(tiles.size());
-    std::vector<uint> rowBlocksTot; 
-    rowBlocksTot.reserve(tiles.size());
-    std::vector<uint> vecBlocksTot; 
-    vecBlocksTot.reserve(tiles.size());
+    // Per tile format, the cheapest the xclbin decodes
+    PhaseTimer formatsTimer(timers, "tile_formats");
+    auto tileFormats = SelectTileFormats(tiles, caps.tileFormats, BLOCK_SIZE);
+    formatsTimer.stop();
 
     // For now they are fixed across all the partitions
     uint vecBlocks = ((tiles[0][0]->cols()-1)/BLOCK_SIZE)+1;
-    uint rowBlocks = ((tiles[0][0]->rows())/BLOCK_SIZE)+1; // |row_ptr|=|x|+1
 
     for (int i=0; i<tiles.size(); i++) {
-        uint locVecBlocks = ((tiles[i][0]->cols()-1)/BLOCK_SIZE)+1;
-        uint locRowBlocks = ((tiles[i][0]->rows())/BLOCK_SIZE)+1; // |row_ptr|=|x|+1
-        vecBlocks = locVecBlocks > vecBlocks ? locVecBlocks : vecBlocks;
-        rowBlocks = locRowBlocks > rowBlocks ? locRowBlocks : rowBlocks;
+        for (int j=0; j<tiles[i].size(); j++) { // x partitions can vary in width
+            uint locVecBlocks = ((tiles[i][j]->cols()-1)/BLOCK_SIZE)+1;
+            vecBlocks = locVecBlocks > vecBlocks ? locVecBlocks : vecBlocks;
+        }
     }   
 
-    // TODO: Skip packing for empty tiles
-    PackTilesIntoBuffers(boIndices, boValues, tiles, vecX,
-        nnzBlocksTot, rowBlocksTot, vecBlocksTot, validTiles, vecBlocks, rowBlocks, BLOCK_SIZE);
+    // Buffer layout per CU: the block counts the kernels take and the offsets of x, values and y
+    PhaseTimer allocationTimer(timers, "buffer_allocation");
+    auto bufferPlans = PlanCuBuffers(tiles, tileFormats, vecBlocks, BLOCK_SIZE);
+    AllocateBuffers<T>(device, spmvKrnl1, boIndices, boValues, bufferPlans, BLOCK_SIZE);
+    allocationTimer.stop();
+
+    size_t bufferBytes = 0;
+    for (int i=0; i<tiles.size(); i++) {
+        if (caps.maxTiles && bufferPlans[i].validTiles > caps.maxTiles) {
+            std::cout<< "The valid tiles: " << bufferPlans[i].validTiles << " of CU: " << i 
+                << " exceed the xclbin limit: " << caps.maxTiles << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (bufferPlans[i].validTiles) {
+            bufferBytes += bufferPlans[i].valuesBytes(sizeof(T), BLOCK_SIZE) + bufferPlans[i].indicesBytes(BLOCK_SIZE);
+        }
+    }
+    std::cout << "buffer_bytes: " << bufferBytes << std::endl;
+
+    // CUs without nnz are neither packed nor launched, their y rows stay 0
+    std::vector<int> activeUnits;
+    for (int i=0; i<tiles.size(); i++) {
+        if (bufferPlans[i].validTiles) {
+            activeUnits.push_back(i);
+        }
+    }
+    std::cout << "active_compute_units: " << activeUnits.size() << std::endl;
+
+    PhaseTimer packingTimer(timers, "packing");
+    if (!PackTilesIntoBuffers(boIndices, boValues, tiles, tileFormats, vecXPacked, bufferPlans, vecBlocks, BLOCK_SIZE)) {
+        return EXIT_FAILURE;
+    }
+    std::cout<< "packing_time (sec): " << packingTimer.stop() << std::endl;
 
     if (verifiability&2) {
-         // TODO: add the sparse tile skipping logic in here.
-        VerifyTilesPacking(boIndices, boValues, tiles, validTiles, rowBlocks, vecBlocks, BLOCK_SIZE);
+        PhaseTimer verifyTimer(timers, "verify_packing");
+        VerifyTilesPacking(boIndices, boValues, tiles, tileFormats, bufferPlans, vecBlocks, BLOCK_SIZE);
     }
 
     // Sync. buffers to FPGA
-    for (int i=0; i<tiles.size(); i++) {
+    PhaseTimer syncTimer(timers, "sync_to_device");
+    for (auto i : activeUnits) {
         boValues[i].sync(XCL_BO_SYNC_BO_TO_DEVICE);
         boIndices[i].sync(XCL_BO_SYNC_BO_TO_DEVICE);
     }
+    std::cout<< "sync_to_device_time (sec): " << syncTimer.stop() << std::endl;
 
     // End: Device buffer creation and assignment
 
@@ -244,40 +386,44 @@ int RunHiHiSpMV(
                         runKrnl4(tiles.size());
 
     for (uint i=0; i<runs; i++) {
-        for (int j=0; j<tiles.size(); j++) {
+        PhaseTimer setupTimer(timers, "run_setup");
+        for (auto j : activeUnits) {
             runKrnl1[j] = xrt::run(spmvKrnl1[j]);
-            runKrnl1[j].set_arg(3, boValues[j]); 
-            runKrnl1[j].set_arg(4, boIndices[j]);
-            runKrnl1[j].set_arg(5, vecBlocksTot[j]); // TODO: do the total calculation above
-            runKrnl1[j].set_arg(6, rowBlocksTot[j]); // TODO: do the total calculation above
-            runKrnl1[j].set_arg(7, vecBlocks); // vecBlock constant across all the tiles
-            runKrnl1[j].set_arg(8, nnzBlocksTot[j]); // TODO: do the total calculation above
-            runKrnl1[j].set_arg(9, iterations); 
+            runKrnl1[j].set_arg(4, boValues[j]); 
+            runKrnl1[j].set_arg(5, boIndices[j]);
+            runKrnl1[j].set_arg(6, boValues[j]); // x segments, read on their own port
+            runKrnl1[j].set_arg(7, bufferPlans[j].vecBlocks);
+            runKrnl1[j].set_arg(8, bufferPlans[j].rowBlocks);
+            runKrnl1[j].set_arg(9, bufferPlans[j].yBlocks); // y partition of the CU
+            runKrnl1[j].set_arg(10, bufferPlans[j].nnzBlocks);
+            runKrnl1[j].set_arg(11, bufferPlans[j].colBlocks);
+            runKrnl1[j].set_arg(12, bufferPlans[j].tileBlocks);
+            runKrnl1[j].set_arg(13, iterations); 
 
             runKrnl2[j] = xrt::run(spmvKrnl2[j]);
-            runKrnl2[j].set_arg(4, vecBlocks); // vecBlock constant across all the tiles
-            runKrnl2[j].set_arg(5, rowBlocks);
-            runKrnl2[j].set_arg(6, tiles[j][0]->rows());
-            runKrnl2[j].set_arg(7, validTiles[j]); //
-            runKrnl2[j].set_arg(8, nnzBlocksTot[j]); // TODO: do the total calculation above
-            runKrnl2[j].set_arg(9, iterations);
+            runKrnl2[j].set_arg(5, vecBlocks); // vecBlock constant across all the tiles
+            runKrnl2[j].set_arg(6, bufferPlans[j].validTiles);
+            runKrnl2[j].set_arg(7, bufferPlans[j].prodBlocks);
+            runKrnl2[j].set_arg(8, iterations);
 
             runKrnl3[j] = xrt::run(spmvKrnl3[j]);
-            runKrnl3[j].set_arg(3, validTiles[j]); 
-            runKrnl3[j].set_arg(4, nnzBlocksTot[j]); // TODO: do the total calculation above
+            runKrnl3[j].set_arg(3, bufferPlans[j].validTiles); 
+            runKrnl3[j].set_arg(4, bufferPlans[j].nnzBlocks);
             runKrnl3[j].set_arg(5, iterations); 
 
             runKrnl4[j] = xrt::run(spmvKrnl4[j]);
-            runKrnl4[j].set_arg(2, vecBlocks); // vecBlock constant across all the tiles
-            runKrnl4[j].set_arg(3, validTiles[j]);
+            runKrnl4[j].set_arg(2, bufferPlans[j].yBlocks); // y partition of the CU
+            runKrnl4[j].set_arg(3, bufferPlans[j].validTiles);
             runKrnl4[j].set_arg(4, iterations); 
 
         }
 
+        setupTimer.stop();
+
         std::chrono::duration<double> kernelTime;
         auto kernel_start = std::chrono::high_resolution_clock::now();
 
-        for (int j=0; j<tiles.size(); j++) {
+        for (auto j : activeUnits) {
             runKrnl2[j].start();
             runKrnl3[j].start();
             runKrnl4[j].start();    
@@ -296,17 +442,17 @@ int RunHiHiSpMV(
         kernelTime = std::chrono::duration<double>(kernelEnd - kernel_start);
 #else
         kernel_start = std::chrono::high_resolution_clock::now();
-        for (int j=0; j<tiles.size(); j++) {
+        for (auto j : activeUnits) {
             runKrnl1[j].start();
         }
-        for (int j=0; j<tiles.size(); j++) {
+        for (auto j : activeUnits) {
             runKrnl1[j].wait();
         }
 
         auto kernelEnd = std::chrono::high_resolution_clock::now();
         kernelTime = std::chrono::duration<double>(kernelEnd - kernel_start);
 
-        for (int j=0; j<tiles.size(); j++) {
+        for (auto j : activeUnits) {
             runKrnl2[j].wait();
             runKrnl3[j].wait();
             runKrnl4[j].wait();
@@ -322,48 +468,86 @@ int RunHiHiSpMV(
         }
 
         totalKernelTime += kernelTime;
+        timers.add("kernel_run", kernelTime.count());
     }
     
-    uint transBlocks = 0;
-    for (int i=0; i<tiles.size(); i++) {
-        transBlocks += nnzBlocksTot[i] * 2; // col indices + nnz vals
-        transBlocks += rowBlocksTot[i] + rowBlocks; // row pointers + result y partition
-        transBlocks += vecBlocksTot[i]; // vector x partition
+    // Per iteration the CUs stream the tiles and x segments again, y and the counters once per launch
+    uint64_t iterBlocks = 0, launchBlocks = 0;
+    for (auto i : activeUnits) {
+        iterBlocks += bufferPlans[i].nnzBlocks + bufferPlans[i].colBlocks; // nnz vals + col indices
+        iterBlocks += bufferPlans[i].rowBlocks; // row entries
+        iterBlocks += bufferPlans[i].vecBlocks; // vector x partition
+        iterBlocks += bufferPlans[i].tileBlocks; // tile descriptors
+        launchBlocks += bufferPlans[i].yBlocks + (caps.perfCounters ? PERF_BLOCKS : 0); // result y partition + counters
     }
 
-    auto transBytes = transBlocks * BLOCK_SIZE * sizeof(int);
-    double transferGB = (double) transBytes / ((double)  1024*1024*1024);
+    TrafficBytes traffic;
+    traffic.streamed = (iterations*iterBlocks + launchBlocks) * BLOCK_SIZE * sizeof(int);
+    for (auto i : activeUnits) { // nnz vals, index entries of the tiles' formats and needed x
+        traffic.useful += iterations * packingEstimate.usefulBytes(i);
+    }
+    traffic.useful += (uint64_t) matA->rows() * sizeof(T); // y
+    double transferGB = (double) traffic.streamed / ((double)  1024*1024*1024);
 
     std::cout<< "kernel_lowest_running time (µsec): " 
         << std::chrono::duration_cast<std::chrono::microseconds>(lowestKernelTime).count() << std::endl;
     std::cout<< "kernel_running_time (µsec, avg of " << runs << " runs): " 
         << std::chrono::duration_cast<std::chrono::microseconds>(totalKernelTime).count()/runs << std::endl;
 
+    // Model check: the measured time per run holds the same iterations as the prediction
+    double measuredUsec = std::chrono::duration_cast<std::chrono::microseconds>(totalKernelTime).count()/(double) runs;
+    std::cout<< "perf_model_error (%): " 
+        << 100.0 * (pipelineEstimate.predictUsec(perfModel, iterations) - measuredUsec) / measuredUsec << std::endl;
+
+    if (!reportFile.empty() && reportFile != "-") {
+        PhaseTimer reportTimer(timers, "report_write");
+        if (!WritePartitionReportJson(reportFile, matrixFile, partMethod, packingEstimate, pipelineEstimate, 
+                perfModel, iterations, measuredUsec, BLOCK_SIZE)) {
+            return EXIT_FAILURE;
+        }
+        std::cout<< "report_file: " << reportFile << std::endl;
+    }
+
     std::cout<< "data_transfer_per_run_(MiB): " << transferGB*1024 << std::endl;
-    std::cout<< "effective_bandwidth (GiB/Sec): " << (transferGB*runs*iterations) / (double) totalKernelTime.count() << std::endl;
-    std::cout<< "highest_effective_bandwidth (GiB/Sec): " << (transferGB*iterations) / (double) lowestKernelTime.count() << std::endl;
+    std::cout<< "effective_bandwidth (GiB/Sec, streamed bytes): " << (transferGB*runs) / (double) totalKernelTime.count() << std::endl;
+    std::cout<< "highest_effective_bandwidth (GiB/Sec, streamed bytes): " << transferGB / (double) lowestKernelTime.count() << std::endl;
+    ReportTrafficBandwidth(traffic, activeUnits.size(), totalKernelTime.count()/runs, lowestKernelTime.count());
 
     double flops = matA->nnz() * 2;
     double gflops = flops / (1000 * 1000 * 1000);
-    std::cout<< "effective_GFLOPS (upper-bound): " << (gflops*runs*iterations) / (double) totalKernelTime.count() << std::endl;
-    std::cout<< "highest_effective_GFLOPS (upper-bound): " << (gflops*iterations) / (double) lowestKernelTime.count() << std::endl;
-
-    for (int i=0; i<tiles.size(); i++) {
-        boValues[i].sync(XCL_BO_SYNC_BO_FROM_DEVICE);
+    std::cout<< "effective_GFLOPS: " << (gflops*runs*iterations) / (double) totalKernelTime.count() << std::endl;
+    std::cout<< "highest_effective_GFLOPS: " << (gflops*iterations) / (double) lowestKernelTime.count() << std::endl;
+
+    PhaseTimer readbackTimer(timers, "readback");
+    PhaseTimer syncFromTimer(timers, "sync_from_device");
+    for (auto i : activeUnits) { // y and the counter blocks only
+        auto yOffset = bufferPlans[i].yOffset(BLOCK_SIZE)*sizeof(T);
+        boValues[i].sync(XCL_BO_SYNC_BO_FROM_DEVICE, boValues[i].size()-yOffset, yOffset);
     }
+    syncFromTimer.stop();
 
     int locRows = 0;
     for (int i=0; i<tiles.size(); i++) {
+        if (!bufferPlans[i].validTiles) { // Not launched, its rows are empty
+            locRows += tiles[i][0]->rows();
+            continue;
+        }
         auto bo_vals_map = boValues[i].map<T*>();
-        auto offset = nnzBlocksTot[i] + vecBlocksTot[i];
-        offset *= BLOCK_SIZE;
+        auto offset = bufferPlans[i].yOffset(BLOCK_SIZE);
         for (int j=0; j<tiles[i][0]->rows(); j++) { 
             int index = partMethod == 1 ? locRows+j : yPartRows[i][j];
             vecB[index] = bo_vals_map[j+offset];
         }
         locRows += tiles[i][0]->rows();
     }
+    ReduceSplitRows(vecB, matA->rows(), splitRows);
+    std::cout<< "readback_time (sec): " << readbackTimer.stop() << std::endl;
 
+    if (caps.perfCounters) { // Counter blocks of the last launch, behind the y partitions
+        ReportPerfCounters(boValues, bufferPlans, BLOCK_SIZE);
+    }
+
+    PhaseTimer validationTimer(timers, "validation");
     float tol = 1 / (double) std::pow(10, 4);
     int mismatchs = 0;
     for (int mm = 0; mm < vecB.size(); ++mm) {
@@ -383,19 +567,35 @@ int RunHiHiSpMV(
         std::cout << "Validation failed\n";
         std::cout<< std::fixed << std::setprecision(6) << "errors, tol = " << tol << ", num_mismatch = " << mismatchs << " , percent = " <<  diffpercent << std::endl;
     }
+    validationTimer.stop();
+
+    ReportPhaseTimers(timers);
+    if (!metricsFile.empty()) {
+        if (!WritePhaseTimers(metricsFile, timers)) {
+            return EXIT_FAILURE;
+        }
+        std::cout<< "metrics_file: " << metricsFile << std::endl;
+    }
     return 0;
 }
 
 int main(int argc, char** argv) {
 
-    if (argc != 11) { // TODO: Support optional args 
+    if (argc < 11 || argc > 13) { // TODO: Support optional args 
         std::cout << "Arguments: " << argc << std::endl;
         std::cout << "Usage: " << argv[0] << " <XCLBIN File> <Matrix File> <Device Id> <Test type> " 
-            << "<CU Count> <Tiles in Part.> <HW Size> <CSR Part. Method> <Iterations> <Runs> " << std::endl;
+            << "<CU Count> <Tiles in Part.> <HW Size> <CSR Part. Method> <Iterations> <Runs> [<Report File> [<Metrics File>]]" << std::endl;
         std::cout << "      <Test Type>: 1 = CSR SpMV on FPGA (4 kernel group replicated multi-tile)" << std::endl;
+        std::cout << "      <CU Count>, <HW Size>: 0 = read from the xclbin" << std::endl;
+        std::cout << "      <XCLBIN File>: comma-separated variants, the one predicted fastest for the matrix is used" << std::endl;
+        std::cout << "      <Matrix File>: or gen:<band|blockdiag|random|rmat|stencil5|stencil7|stencil27>:<rows>[x<cols>][:<nnz per row>[:<seed>]]" << std::endl;
+        std::cout << "      <Report File>: optional, per CU load and padding report as JSON, - for none" << std::endl;
+        std::cout << "      <Metrics File>: optional, host phase times (min/median/p99) as JSON (.json) or CSV" << std::endl;
         std::cout << "      <CSR Part. Method>: 1 = Static spatial bounds  distribution" << std::endl;
         std::cout << "      <CSR Part. Method>: 2 = Balanced rows/nnz per partition and static spatial bounds colum distribution" << std::endl;
         std::cout << "      <CSR Part. Method>: 3 = Balanced rows/nnz per partition and col-shuffle to pack tiles denser; left-to-right" << std::endl;
+        std::cout << "      <CSR Part. Method>: 4 = Balanced rows/nnz per partition and adaptive colum bounds from the column nnz histogram" << std::endl;
+        std::cout << "      <CSR Part. Method>: 5 = Rows grouped by column footprint for balanced streamed blocks per partition and adaptive colum bounds" << std::endl;
 
         return EXIT_FAILURE;
     }
@@ -413,13 +613,12 @@ int main(int argc, char** argv) {
     int testType = std::stoi(argv[4]);
     std::cout << "testType: " << testType << std::endl;
 
-    int computeUnits = std::stoi(argv[5]);
-    std::cout << "computeUnits: " << computeUnits << std::endl;
+    int computeUnits = std::stoi(argv[5]); // 0 = all CUs in the xclbin
 
     int tilesInPart = std::stoi(argv[6]);
     std::cout << "tilesInPart: " << tilesInPart << std::endl;
 
-    int hwSideLen = std::stoi(argv[7]);
+    int hwSideLen = std::stoi(argv[7]); // 0 = VECTOR_SIZE of the xclbin
 
     int partMethod = std::stoi(argv[8]); // Todo: convert to enum
     std::cout << "partMethod: " << partMethod << std::endl;
@@ -430,13 +629,16 @@ int main(int argc, char** argv) {
     int runs = std::stoi(argv[10]);
     std::cout << "runs: " << runs << std::endl;
 
+    std::string reportFile = argc > 11 ? argv[11] : "";
+    std::string metricsFile = argc > 12 ? argv[12] : "";
+
     int verifiability = 0, // Todo: convert to enum
         verbosity = 1;
 
     switch (testType) { 
         case 0: 
             return RunHiHiSpMV<float>(binaryFile, matrixFile, deviceIndex, 
-                        computeUnits, tilesInPart, hwSideLen, iterations, runs, partMethod, verifiability, verbosity); 
+                        computeUnits, tilesInPart, hwSideLen, iterations, runs, partMethod, verifiability, verbosity, reportFile, metricsFile); 
             break;
         default: // Other test calls can be incoporated if needed           
             std::cout << "<Test type>: " << testType << " is not defined." << std::endl;
@@ -24,15 +24,19 @@ SOFTWARE.
 
 #pragma once
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <limits>
+#include <cmath>
 
 #include "../include/includes.hpp"
 #include "../include/dense_vector.hpp"
 #include "../include/csr_matrix.hpp"
 #include "../include/index_value_pair.hpp"
+#include "tile_formats.hpp"
+#include "kernels/xlx_interface.hpp"
 
 #include <xrt/xrt_device.h>
 #include <experimental/xrt_xclbin.h>
@@ -44,6 +48,329 @@ SOFTWARE.
 #define hw_emu  1
 #define hw      2
 
+// Capacity block of the csr_spmv_caps kernel, and the counter blocks behind each CU's y partition
+#define CAPS_KERNEL "csr_spmv_caps"
+
+// Buffer sizes are rounded up to an AXI burst of the kernels' 512-bit ports
+#define BUFFER_ALIGNMENT 64
+
+// Limits of a loaded xclbin
+struct HardwareCaps {
+    bool queried = false; // Limits read from the caps kernel, else only the CU count is known
+    uint vectorSize = 0; // Max. square tile side length
+    uint blockSize = 0;
+    uint maxTiles = 0; // Tiles per CU, 0 = unbounded
+    uint precSize = 0; // Value bits
+    uint uram = 0;
+    uint perfCounters = 0; // Counter blocks behind the y partitions
+    uint tileFormats = 1 << TILE_FORMAT_CSR; // A bit per decoded tile format
+    uint computeUnits = 0; // Complete 4 kernel groups
+};
+
+// The packers below write at most maxBlocks blocks (the tile's share of the CU buffer plan) and
+// return maxBlocks+1 if the tile needs more, so a plan mismatch never writes past the buffers.
+
+// Writes the (row << ROW_ENTRY_SHIFT) | row nnz entries of the tile's non-empty rows, closed by 
+// the end entry, and returns the number of blocks written
+template <typename T> 
+uint PackRowEntries(
+        const CSRMatrix<T> &tile,
+        int *dest,
+        uint maxBlocks,
+        uint blockSize) {
+
+    uint entries = 0;
+    for (int row=0; row<tile.rows(); row++) {
+        int rowNnz = tile.getRowPointer(row+1) - tile.getRowPointer(row);
+        if (rowNnz) {
+            if (entries+1 >= maxBlocks*blockSize) return maxBlocks+1; // Room for the end entry
+            dest[entries++] = (row << ROW_ENTRY_SHIFT) | rowNnz;
+        }
+    }
+    if (entries >= maxBlocks*blockSize) return maxBlocks+1;
+    dest[entries++] = ROW_ENTRY_END;
+    return ((entries-1)/blockSize)+1;
+}
+
+// Writes the ((first row) << ROW_ENTRY_SHIFT) | ROW_ENTRY_SLICE | width entries of the tile's non-empty
+// SELL, BCSR or DIA slices, closed by the end entry, and returns the number of blocks written. The
+// width is the slice's longest row for SELL, its blocks for BCSR and the tile's diagonals for DIA.
+template <typename T> 
+uint PackSliceEntries(
+        const CSRMatrix<T> &tile,
+        int *dest,
+        int format,
+        uint maxBlocks,
+        uint blockSize) {
+
+    uint entries = 0;
+    std::vector<int> blocks, diagonals;
+    ListTileDiagonals(tile, blockSize, diagonals);
+    for (int first=0; first<tile.rows(); first+=blockSize) {
+        int width = 0;
+        for (int row=first; row<std::min(first+blockSize, (uint) tile.rows()); row++) {
+            width = std::max(width, tile.getRowPointer(row+1) - tile.getRowPointer(row));
+        }
+        if (width && format == TILE_FORMAT_BCSR) {
+            ListSliceBlocks(tile, first, blockSize, blocks);
+            width = blocks.size();
+        }
+        if (width && format == TILE_FORMAT_DIA) {
+            width = diagonals.size();
+        }
+        if (width) {
+            if (entries+1 >= maxBlocks*blockSize) return maxBlocks+1; // Room for the end entry
+            dest[entries++] = (first << ROW_ENTRY_SHIFT) | ROW_ENTRY_SLICE | width;
+        }
+    }
+    if (entries >= maxBlocks*blockSize) return maxBlocks+1;
+    dest[entries++] = ROW_ENTRY_END;
+    return ((entries-1)/blockSize)+1;
+}
+
+// Writes the non-empty SELL slices' blocks, block k of a slice holding the k-th nnz of each of its 
+// rows (zero padded), and returns the number of value (and as many column) blocks written
+template <typename T> 
+uint PackSliceValues(
+        const CSRMatrix<T> &tile,
+        int *cols,
+        T *values,
+        uint maxBlocks,
+        uint blockSize) {
+
+    uint blocks = 0;
+    for (int first=0; first<tile.rows(); first+=blockSize) {
+        int width = 0;
+        for (int row=first; row<std::min(first+blockSize, (uint) tile.rows()); row++) {
+            width = std::max(width, tile.getRowPointer(row+1) - tile.getRowPointer(row));
+        }
+        if (blocks+width > maxBlocks) return maxBlocks+1;
+        for (int k=0; k<width; k++, blocks++) {
+            for (int lane=0; lane<blockSize; lane++) { // Lanes past the tile's rows are padding too
+                bool pad = first+lane >= tile.rows();
+                int ind = pad ? 0 : tile.getRowPointer(first+lane)+k;
+                pad = pad || ind >= tile.getRowPointer(first+lane+1);
+                cols[blocks*blockSize+lane] = pad ? 0 : tile.getColIndex(ind);
+                values[blocks*blockSize+lane] = pad ? 0 : tile.getData(ind);
+            }
+        }
+    }
+    return blocks;
+}
+
+// Writes the non-empty BCSR blocks of the slices, a value block each in row-major order and their 
+// entries packed into column blocks, and returns the number of value blocks written
+template <typename T> 
+uint PackBlockValues(
+        const CSRMatrix<T> &tile,
+        int *cols,
+        T *values,
+        uint maxBlocks,
+        uint blockSize) {
+
+    uint blockRows = blockSize/BCSR_C, written = 0;
+    std::vector<int> blocks;
+    for (int first=0; first<tile.rows(); first+=blockSize) {
+        ListSliceBlocks(tile, first, blockSize, blocks);
+        if (written+blocks.size() > maxBlocks) return maxBlocks+1; // Columns fit as they pack blockSize per block
+        for (auto entry : blocks) {
+            std::fill(values+written*blockSize, values+(written+1)*blockSize, 0);
+            cols[written++] = entry;
+        }
+        for (int row=first; row<std::min(first+blockSize, (uint) tile.rows()); row++) {
+            int blockRow = (row-first)/blockRows;
+            for (int ind=tile.getRowPointer(row); ind<tile.getRowPointer(row+1); ind++) {
+                int col = tile.getColIndex(ind);
+                int entry = blockRow << ROW_ENTRY_SHIFT | (col/BCSR_C)*BCSR_C;
+                uint block = written-blocks.size() + (std::lower_bound(blocks.begin(), blocks.end(), entry) - blocks.begin());
+                values[block*blockSize + ((row-first)%blockRows)*BCSR_C + col%BCSR_C] = tile.getData(ind);
+            }
+        }
+    }
+    return written;
+}
+
+// Writes the tile's diagonal offsets into a single column block and the non-empty slices' blocks, 
+// block k holding the k-th diagonal of the slice's rows (zero padded), and returns the number of 
+// value blocks written
+template <typename T> 
+uint PackDiagonalValues(
+        const CSRMatrix<T> &tile,
+        int *offsets,
+        T *values,
+        uint maxBlocks,
+        uint blockSize) {
+
+    std::vector<int> diagonals;
+    ListTileDiagonals(tile, blockSize, diagonals);
+    std::fill(offsets, offsets+blockSize, 0);
+    std::copy(diagonals.begin(), diagonals.end(), offsets);
+
+    uint blocks = 0;
+    for (int first=0; first<tile.rows(); first+=blockSize) {
+        if (tile.getRowPointer(std::min(first+blockSize, (uint) tile.rows())) == tile.getRowPointer(first)) {
+            continue; // Empty slice
+        }
+        if (blocks+diagonals.size() > maxBlocks) return maxBlocks+1;
+        std::fill(values+blocks*blockSize, values+(blocks+diagonals.size())*blockSize, 0);
+        for (int row=first; row<std::min(first+blockSize, (uint) tile.rows()); row++) {
+            for (int ind=tile.getRowPointer(row); ind<tile.getRowPointer(row+1); ind++) {
+                int k = std::lower_bound(diagonals.begin(), diagonals.end(), tile.getColIndex(ind)-row) - diagonals.begin();
+                values[(blocks+k)*blockSize + row-first] = tile.getData(ind);
+            }
+        }
+        blocks += diagonals.size();
+    }
+    return blocks;
+}
+
+// Writes the (row << ROW_ENTRY_SHIFT) | column COO indices of the tile's nnz, a row never crossing a
+// block (the lanes up to the next block hold its column 0 and zero values), and returns the number 
+// of blocks written
+template <typename T> 
+uint PackCooValues(
+        const CSRMatrix<T> &tile,
+        int *indices,
+        T *values,
+        uint maxBlocks,
+        uint blockSize) {
+
+    uint lanes = 0; // Of all the blocks written
+    for (int row=0; row<tile.rows(); row++) {
+        uint rowNnz = tile.getRowPointer(row+1) - tile.getRowPointer(row);
+        if (!rowNnz) continue;
+        if (lanes%blockSize && lanes%blockSize+rowNnz > blockSize) { // Pad the previous row to the block
+            int prevRow = indices[lanes-1] >> ROW_ENTRY_SHIFT;
+            for (; lanes%blockSize; lanes++) {
+                indices[lanes] = prevRow << ROW_ENTRY_SHIFT;
+                values[lanes] = 0;
+            }
+        }
+        if (lanes+rowNnz > maxBlocks*blockSize) return maxBlocks+1;
+        for (int ind=tile.getRowPointer(row); ind<tile.getRowPointer(row+1); ind++, lanes++) {
+            indices[lanes] = row << ROW_ENTRY_SHIFT | tile.getColIndex(ind);
+            values[lanes] = tile.getData(ind);
+        }
+    }
+    int lastRow = lanes ? indices[lanes-1] >> ROW_ENTRY_SHIFT : 0;
+    for (; lanes%blockSize; lanes++) {
+        indices[lanes] = lastRow << ROW_ENTRY_SHIFT;
+        values[lanes] = 0;
+    }
+    return lanes/blockSize;
+}
+
+// Counts the CUs of the 4 kernel group in the xclbin metadata and runs the caps kernel, if linked
+HardwareCaps ReadHardwareCaps(
+        xrt::device &device,
+        xrt::uuid &uuid,
+        std::string &binaryFile,
+        uint blockSize,
+        int verbosity) {
+
+    HardwareCaps caps;
+    bool hasCapsKernel = false;
+
+    auto bitstream = xrt::xclbin(binaryFile);
+    std::vector<uint> spmvCus(4, 0);
+    for (auto kernel : bitstream.get_kernels()) {
+        auto name = kernel.get_name();
+        for (int k=0; k<4; k++) {
+            if (name == "csr_spmv_repl_" + std::to_string(k+1)) {
+                spmvCus[k] = kernel.get_cus().size();
+            }
+        }
+        hasCapsKernel |= name == CAPS_KERNEL;
+    }
+    caps.computeUnits = *std::min_element(spmvCus.begin(), spmvCus.end());
+
+    if (hasCapsKernel) { // Older xclbins come without it
+        auto capsKrnl = xrt::kernel(device, uuid, std::string(CAPS_KERNEL) + ":{" + CAPS_KERNEL + "_1}");
+        auto boCaps = xrt::bo(device, blockSize*sizeof(int), xrt::bo::flags::normal, capsKrnl.group_id(0));
+        auto runCaps = xrt::run(capsKrnl);
+        runCaps.set_arg(0, boCaps);
+        runCaps.start();
+        runCaps.wait();
+        boCaps.sync(XCL_BO_SYNC_BO_FROM_DEVICE);
+
+        auto capsMap = boCaps.map<int*>();
+        caps.queried = capsMap[CAPS_MAGIC_INDEX] == CAPS_MAGIC;
+        if (caps.queried) {
+            caps.vectorSize = capsMap[CAPS_VECTOR_SIZE_INDEX];
+            caps.blockSize = capsMap[CAPS_BLOCK_SIZE_INDEX];
+            caps.maxTiles = capsMap[CAPS_MAX_TILES_INDEX];
+            caps.precSize = capsMap[CAPS_PREC_SIZE_INDEX];
+            caps.uram = capsMap[CAPS_URAM_INDEX];
+            caps.perfCounters = capsMap[CAPS_PERF_COUNTERS_INDEX];
+            caps.tileFormats |= capsMap[CAPS_TILE_FORMATS_INDEX];
+        }
+    }
+
+    if (verbosity&1) {
+        std::cout << "hw_caps_queried: " << caps.queried << std::endl;
+        std::cout << "hw_caps_compute_units: " << caps.computeUnits << std::endl;
+        if (caps.queried) {
+            std::cout << "hw_caps_vector_size: " << caps.vectorSize << std::endl;
+            std::cout << "hw_caps_block_size: " << caps.blockSize << std::endl;
+            std::cout << "hw_caps_max_tiles: " << caps.maxTiles << std::endl;
+            std::cout << "hw_caps_prec_size: " << caps.precSize << std::endl;
+            std::cout << "hw_caps_uram: " << caps.uram << std::endl;
+            std::cout << "hw_caps_perf_counters: " << caps.perfCounters << std::endl;
+            std::cout << "hw_caps_tile_formats: " << caps.tileFormats << std::endl;
+        }
+    }
+    return caps;
+}
+
+// Takes a CU count and HW size of 0 from the xclbin limits, and checks given ones against them 
+// and the matrix. Returns false with a message if the xclbin can not run the matrix.
+bool ResolveHardwareLimits(
+        const HardwareCaps &caps,
+        uint blockSize,
+        uint precSize,
+        int matRows,
+        int &computeUnits,
+        int &hwSideLen) {
+
+    if (caps.queried && (caps.blockSize != blockSize || caps.precSize != precSize)) {
+        std::cout<< "The xclbin block size: " << caps.blockSize << " and precision: " << caps.precSize 
+            << " do not match the host's: " << blockSize << " and " << precSize << std::endl;
+        return false;
+    }
+
+    if (computeUnits == 0) {
+        computeUnits = caps.computeUnits;
+    }
+    if (computeUnits == 0 || computeUnits > caps.computeUnits) {
+        std::cout<< "The CU count: " << computeUnits 
+            << " is not available in the xclbin with: " << caps.computeUnits << " CUs" << std::endl;
+        return false;
+    }
+
+    if (hwSideLen == 0) {
+        hwSideLen = caps.vectorSize;
+    }
+    if (hwSideLen == 0 || (caps.queried && hwSideLen > caps.vectorSize)) {
+        std::cout<< "The hardware size: " << hwSideLen 
+            << " is not supported by the xclbin with: " << caps.vectorSize 
+            << (caps.queried ? "" : " (no caps kernel, give the HW size)") << std::endl;
+        return false;
+    }
+
+    if (hwSideLen+blockSize > ROW_ENTRY_SLICE-1) { // Row entries hold 15-bit rows and lengths
+        std::cout<< "The hardware size: " << hwSideLen 
+            <<  " exceeds the row entry limit: " << ROW_ENTRY_SLICE-1-blockSize << std::endl;
+        return false;
+    }
+
+    if (hwSideLen < std::ceil(matRows/(double)computeUnits)) {
+        std::cout<< "The hardware size: " << hwSideLen 
+            <<  " can not accomodate y_partition size: " << matRows/computeUnits << std::endl;
+        return false;
+    }
+    return true;
+}
+
 void CreateKernels(
         std::vector<xrt::kernel> &spmvKrnl1, 
         std::vector<xrt::kernel> &spmvKrnl2,
@@ -73,8 +400,8 @@ void CreateKernels(
             std::cout << spmvKrnl2Id + ":{" + spmvKrnl2Id + cuNum + "}" <<  std::endl;
             std::cout << spmvKrnl3Id + ":{" + spmvKrnl3Id + cuNum + "}" <<  std::endl;
             std::cout << spmvKrnl4Id + ":{" + spmvKrnl4Id + cuNum + "}" <<  std::endl;
-            std::cout << "krnl_1_" << i << ".group_id(3): " << x.group_id(3) <<  std::endl;
             std::cout << "krnl_1_" << i << ".group_id(4): " << x.group_id(4) <<  std::endl;
+            std::cout << "krnl_1_" << i << ".group_id(5): " << x.group_id(5) <<  std::endl;
         }
     }
 
@@ -110,49 +437,79 @@ void CreateKernels(
     }
 }
 
+// Buffer layout of a CU, in blocks of blockSize elements. The kernels stream each region in a 
+// single pass, so the regions follow each other tightly. Values: the x segments of the valid 
+// tiles, the tiles' values, y and the counter blocks. Indices: a tile descriptor block ahead of 
+// every blockSize valid tiles, each followed by the row or slice entries and columns of its tiles.
+struct CuBufferPlan {
+    uint validTiles = 0; // Non-empty tiles, the only ones packed
+    uint vecBlocks = 0; // x segments, maxVecBlocks per valid tile
+    uint nnzBlocks = 0; // Value blocks
+    uint colBlocks = 0; // Column blocks, a single one per blockSize BCSR blocks
+    uint prodBlocks = 0; // Product blocks out of k2, a single one per slice
+    uint rowBlocks = 0; // Row or slice entry blocks
+    uint tileBlocks = 0; // Tile descriptor blocks
+    uint yBlocks = 0;
+
+    uint valOffset(uint blockSize) const { return vecBlocks*blockSize; } // Elements
+    uint yOffset(uint blockSize) const { return (vecBlocks+nnzBlocks)*blockSize; }
+    uint perfOffset(uint blockSize) const { return (vecBlocks+nnzBlocks+yBlocks)*blockSize; }
+    size_t valuesBytes(size_t valueSize, uint blockSize) const {
+        size_t bytes = (size_t) (vecBlocks+nnzBlocks+yBlocks+PERF_BLOCKS)*blockSize*valueSize;
+        return ((bytes+BUFFER_ALIGNMENT-1)/BUFFER_ALIGNMENT)*BUFFER_ALIGNMENT;
+    }
+    size_t indicesBytes(uint blockSize) const {
+        size_t bytes = (size_t) (tileBlocks+rowBlocks+colBlocks)*blockSize*sizeof(int);
+        return ((bytes+BUFFER_ALIGNMENT-1)/BUFFER_ALIGNMENT)*BUFFER_ALIGNMENT;
+    }
+};
+
+// Buffer layouts of the CUs from the tiles' shapes in their formats, shared by the allocation,
+// packing, its verification and the readback
+template <typename T> 
+std::vector<CuBufferPlan> PlanCuBuffers(
+        std::vector<std::vector<CSRMatrix<T>*>> &tiles,
+        std::vector<std::vector<int>> &tileFormats,
+        uint maxVecBlocks,
+        uint blockSize) {
+
+    auto plans = std::vector<CuBufferPlan>(tiles.size());
+    for (int i=0; i<tiles.size(); i++) {
+        auto &plan = plans[i];
+        for (int j=0; j<tiles[i].size(); j++) {
+            if (!tiles[i][j]->nnz()) continue; // Empty tiles are not packed
+            int format = tileFormats[i][j];
+            auto shape = MeasureTileShape(*tiles[i][j], blockSize);
+            plan.validTiles++;
+            plan.vecBlocks += maxVecBlocks;
+            plan.nnzBlocks += shape.valueBlocks(format, blockSize);
+            plan.colBlocks += shape.colBlocks(format, blockSize);
+            plan.prodBlocks += shape.prodBlocks(format, blockSize);
+            plan.rowBlocks += shape.entryBlocks(format, blockSize);
+        }
+        plan.tileBlocks = plan.validTiles ? ((plan.validTiles-1)/blockSize)+1 : 0;
+        plan.yBlocks = ((tiles[i][0]->rows())/blockSize)+1; // never empty
+    }
+    return plans;
+}
+
 template <typename T> 
 void AllocateBuffers(
         xrt::device &device,
         std::vector<xrt::kernel> &spmvKrnl1,
         std::vector<xrt::bo> &boIndices,
         std::vector<xrt::bo> &boValues, 
-        std::vector<std::vector<CSRMatrix<T>*>> &tiles,
-        std::vector<uint> &validTiles,
+        std::vector<CuBufferPlan> &plans,
         uint blockSize) {
     auto normalFlags =  xrt::bo::flags::normal;
-    int pageSize = 4*1024;
-
-    for (int i=0; i<tiles.size(); i++) {
-        int valuesBytes = 0, // (x vector part + nnz vals)*tiles + result y part
-            indicesBytes = 0,
-            rowBlockBytesMax = 0; // (row ptr part + nnz cols)*tiles
-        
-        uint valid_tile=0;
-        for (int j=0; j<tiles[i].size(); j++) {
-            auto tile = tiles[i][j];
-            auto tileNnz = tile->nnz();
-
-            uint nnzBlocks = ((tiles[i][j]->nnz()-1)/blockSize)+1;
-            uint rowBlocks = ((tiles[i][j]->rows())/blockSize)+1; // |row_ptr| = |vec|+1
-            uint vecBlocks = ((tiles[i][j]->cols()-1)/blockSize)+1;
-            uint valueBlockBytes = sizeof(T) * nnzBlocks * blockSize; //csr value bytes
-            uint colBlockBytes = sizeof(int) * nnzBlocks * blockSize; //col data bytes
-            uint rowBlockBytes = sizeof(int) * rowBlocks * blockSize; //csr row pointer size
-            uint vecBlockBytes = sizeof(T)* vecBlocks * blockSize;
-
-            // Max row blocks for y partition read-out
-            rowBlockBytesMax = rowBlockBytes > rowBlockBytesMax ? rowBlockBytes : rowBlockBytesMax;
-            valuesBytes += (((valueBlockBytes + 2*vecBlockBytes)/pageSize)+1)*pageSize; // page-size divisible
-            indicesBytes += (((rowBlockBytes + colBlockBytes)/pageSize)+1)*pageSize; // page-size divisible
-            tileNnz ? ++valid_tile:0;
-        }
-        validTiles[i] = valid_tile;
 
-        valuesBytes += (((rowBlockBytesMax-1)/pageSize)+1)*pageSize; // result y part
-        indicesBytes += pageSize; // nnz per tile
+    for (int i=0; i<plans.size(); i++) {
+        if (!plans[i].validTiles) continue; // CUs without nnz get no buffers and are not launched
+        auto valuesBytes = plans[i].valuesBytes(sizeof(T), blockSize);
+        auto indicesBytes = plans[i].indicesBytes(blockSize);
 
-        boValues[i] = xrt::bo(device, valuesBytes, normalFlags, spmvKrnl1[i].group_id(3));
-        boIndices[i] = xrt::bo(device, indicesBytes, normalFlags, spmvKrnl1[i].group_id(4)); 
+        boValues[i] = xrt::bo(device, valuesBytes, normalFlags, spmvKrnl1[i].group_id(4));
+        boIndices[i] = xrt::bo(device, indicesBytes, normalFlags, spmvKrnl1[i].group_id(5)); 
         
         auto boValsMap = boValues[i].map<T*>(); 
         auto boIndicesMap = boIndices[i].map<int*>();
@@ -162,107 +519,137 @@ void AllocateBuffers(
     }
 }
 
-// Note: For now each tile has maxVecBlocks and maxRowBlocks
+// Note: For now each tile has maxVecBlocks. Each tile is packed within its blocks of the CU buffer 
+// plan, false if a packer needs more (or fewer) blocks than planned.
 template <typename T> 
-void PackTilesIntoBuffers(
+bool PackTilesIntoBuffers(
         std::vector<xrt::bo> &boIndices,
         std::vector<xrt::bo> &boValues, 
         std::vector<std::vector<CSRMatrix<T>*>> &tiles,
+        std::vector<std::vector<int>> &tileFormats,
         DenseVector<T> &vecX,
-        std::vector<uint> &nnzBlocksTot,
-        std::vector<uint> &rowBlocksTot, 
-        std::vector<uint> &vecBlocksTot,
-        std::vector<uint> &validTiles,
+        std::vector<CuBufferPlan> &plans,
         uint maxVecBlocks,
-        uint maxRowBlocks,
         uint blockSize) {
 
     for (int i=0; i<tiles.size(); i++) {
+        if (!plans[i].validTiles) continue; // No buffers, see AllocateBuffers()
+
         auto boValsMap = boValues[i].map<T*>(); 
         auto boIndicesMap = boIndices[i].map<int*>();
+        CuBufferPlan packed; // Blocks as packed, checked against the plan
+        packed.yBlocks = plans[i].yBlocks;
 
-        nnzBlocksTot[i] = 0;
-        rowBlocksTot[i] = 0;
-        vecBlocksTot[i] = 0;
-
-        uint valOffset = 0; // (x vector part + nnz vals)*tiles + result y part
-        uint indOffset = 0; // (row ptr part + nnz cols)*tiles
+        uint xOffset = 0; // x vector part*tiles + nnz vals*tiles + result y part
+        uint valOffset = plans[i].valOffset(blockSize); // x parts of all the valid tiles come first
+        uint indOffset = 0; // (row entries + nnz cols)*tiles
         uint vecOffset = 0; // vecX offset       
+        uint valEnd = plans[i].yOffset(blockSize); // Ends of the planned regions, in elements
+        uint indEnd = (plans[i].tileBlocks+plans[i].rowBlocks+plans[i].colBlocks)*blockSize;
 
-        uint nnzTileBlks = ((validTiles[i]-1)/blockSize)+1;
-        // rowBlocksTot[i] += nnzTileBlks; // hack: counted towards rows_blocks
+        // Tile descriptors (nnz blocks and format per tile), a block ahead of every blockSize valid tiles
+        uint descOffset = indOffset;
         indOffset += 1*blockSize; // offset for nnzs in blocks
+        packed.tileBlocks = 1;
 
         uint valid_tile=0;
         for (int j=0; j<tiles[i].size(); j++) {
             auto tile = tiles[i][j];
             auto tileNnz = tile->nnz();
-            uint nnzBlocks = tileNnz ? ((tileNnz-1)/blockSize)+1 : 0;
-            uint vecBlocks = tileNnz ? maxVecBlocks /*((tile->cols()-1)/blockSize)+1*/ : 0;
-            uint rowBlocks = tileNnz ? maxRowBlocks /*((tile->rows())/blockSize)+1*/ : 0; // |row_ptr| = |vec|+1
+            if (!tileNnz) { // Empty tiles are skipped, neither x nor a descriptor
+                vecOffset += tile->cols();
+                continue;
+            }
+            if (valid_tile && valid_tile%blockSize == 0) {
+                descOffset = indOffset;
+                indOffset += blockSize;
+                packed.tileBlocks++;
+            }
+            int format = tileFormats[i][j];
+            uint vecBlocks = maxVecBlocks /*((tile->cols()-1)/blockSize)+1*/;
+
+            // The tile's blocks as planned, see PlanCuBuffers()
+            auto shape = MeasureTileShape(*tile, blockSize);
+            uint rowBlocks = shape.entryBlocks(format, blockSize);
+            uint nnzBlocks = shape.valueBlocks(format, blockSize);
+            uint colBlocks = shape.colBlocks(format, blockSize);
+            uint prodBlocks = shape.prodBlocks(format, blockSize);
+            if (valOffset+nnzBlocks*blockSize > valEnd || indOffset+(rowBlocks+colBlocks)*blockSize > indEnd
+                    || xOffset+vecBlocks*blockSize > plans[i].valOffset(blockSize)) {
+                std::cout << "Error: cu: " << i << ", tile: " << j << " does not fit the buffer plan" << std::endl;
+                return false;
+            }
             
             // copy partition of x_vec into values
-            auto copyCols = tileNnz ? tile->cols() : 0;
-            std::copy(vecX.elements.get()+vecOffset, vecX.elements.get()+vecOffset+copyCols, boValsMap+valOffset);
+            std::copy(vecX.elements.get()+vecOffset, vecX.elements.get()+vecOffset+tile->cols(), boValsMap+xOffset);
             vecOffset += tile->cols(); // vecX partition size can vary between titles
-            valOffset += vecBlocks*blockSize;
-
-            // copy row pointer of the tile into indices
-            auto copyRows = tileNnz ? + tile->rows()+1 : 0;
-            std::copy(tile->rowPointer.get(), tile->rowPointer.get()+copyRows, boIndicesMap+indOffset);
-            indOffset += rowBlocks*blockSize; // TODO: Convert it to incremental
-
-            // copy nnz values the tile into values
-            std::copy(tile->data.get(), tile->data.get()+tile->nnz(), boValsMap+valOffset);
+            xOffset += vecBlocks*blockSize;
+
+            uint packedRowBlocks, packedNnzBlocks, packedColBlocks;
+            if (format == TILE_FORMAT_COO) { // the end entry alone, the nnz with their rows
+                boIndicesMap[indOffset] = ROW_ENTRY_END;
+                packedRowBlocks = 1;
+                packedNnzBlocks = packedColBlocks = PackCooValues(*tile, boIndicesMap+indOffset+blockSize, 
+                    boValsMap+valOffset, nnzBlocks, blockSize);
+            } else if (format != TILE_FORMAT_CSR) { // slice entries into indices, the slices' values and cols as blocks
+                packedRowBlocks = PackSliceEntries(*tile, boIndicesMap+indOffset, format, rowBlocks, blockSize);
+                int *cols = boIndicesMap+indOffset+rowBlocks*blockSize;
+                if (format == TILE_FORMAT_BCSR) {
+                    packedNnzBlocks = PackBlockValues(*tile, cols, boValsMap+valOffset, nnzBlocks, blockSize);
+                    packedColBlocks = packedNnzBlocks ? ((packedNnzBlocks-1)/blockSize)+1 : 0;
+                } else if (format == TILE_FORMAT_DIA) {
+                    packedNnzBlocks = PackDiagonalValues(*tile, cols, boValsMap+valOffset, nnzBlocks, blockSize);
+                    packedColBlocks = 1;
+                } else {
+                    packedNnzBlocks = packedColBlocks = PackSliceValues(*tile, cols, boValsMap+valOffset, nnzBlocks, blockSize);
+                }
+            } else {
+                // pack the non-empty rows of the tile into indices
+                packedRowBlocks = PackRowEntries(*tile, boIndicesMap+indOffset, rowBlocks, blockSize);
+                packedNnzBlocks = packedColBlocks = ((tileNnz-1)/blockSize)+1;
+                if (packedNnzBlocks == nnzBlocks) {
+                    // copy nnz values the tile into values
+                    std::copy(tile->data.get(), tile->data.get()+tile->nnz(), boValsMap+valOffset);
+                    // copy nnz cols the tile into indices
+                    std::copy(tile->colIndex.get(), tile->colIndex.get()+tile->nnz(), 
+                        boIndicesMap+indOffset+rowBlocks*blockSize);
+                }
+            }
+            if (packedRowBlocks != rowBlocks || packedNnzBlocks != nnzBlocks || packedColBlocks != colBlocks) {
+                std::cout << "Error: cu: " << i << ", tile: " << j << ", buffer plan mismatch: " 
+                    << packedRowBlocks << " vs. " << rowBlocks << " row blocks, " 
+                    << packedNnzBlocks << " vs. " << nnzBlocks << " value blocks, "
+                    << packedColBlocks << " vs. " << colBlocks << " column blocks" << std::endl;
+                return false;
+            }
             valOffset += nnzBlocks*blockSize;
-
-            // copy nnz cols the tile into indices
-            std::copy(tile->colIndex.get(), tile->colIndex.get()+tile->nnz(), boIndicesMap+indOffset);
-            indOffset += nnzBlocks*blockSize;
+            indOffset += (rowBlocks+colBlocks)*blockSize;
 
             // total counts needed for the kernels
-            nnzBlocksTot[i] += nnzBlocks; 
-            rowBlocksTot[i] += rowBlocks;
-            vecBlocksTot[i] += vecBlocks;
-
-            // nnz count in the tile - only write for a valid tile
-            tileNnz ? (boIndicesMap[valid_tile] = nnzBlocks) : 0; 
-            tileNnz ? ++valid_tile:0;
+            packed.rowBlocks += rowBlocks;
+            packed.nnzBlocks += nnzBlocks; 
+            packed.colBlocks += colBlocks;
+            packed.prodBlocks += prodBlocks;
+            packed.vecBlocks += vecBlocks;
+
+            // nnz blocks and format of the tile
+            boIndicesMap[descOffset+valid_tile%blockSize] = nnzBlocks | tileFormats[i][j] << TILE_FORMAT_SHIFT;
+            ++valid_tile;
         }
-        validTiles[i] = valid_tile;
-    }
-}
-
-template <typename T> 
-void PackVecOnlyIntoBuffers(
-        std::vector<xrt::bo> &boValues, 
-        std::vector<std::vector<CSRMatrix<T>*>> &tiles,
-        DenseVector<T> &vecX,
-        uint maxVecBlocks,
-        uint blockSize) {
-
-    for (int i=0; i<tiles.size(); i++) {
-        auto boValsMap = boValues[i].map<T*>(); 
-        uint valOffset = 0; // (x vector part + nnz vals)*tiles + result y part
-        uint vecOffset = 0; // vecX offset       
-
-        uint valid_tile=0;
-        for (int j=0; j<tiles[i].size(); j++) {
-            auto tile = tiles[i][j];
-            auto tileNnz = tile->nnz();
-            uint nnzBlocks = tileNnz ? ((tileNnz-1)/blockSize)+1 : 0;
-            uint vecBlocks = tileNnz ? maxVecBlocks /*((tile->cols()-1)/blockSize)+1*/ : 0;
-            
-            // copy partition of x_vec into values
-            auto copyCols = tileNnz ? tile->cols() : 0;
-            std::copy(vecX.elements.get()+vecOffset, vecX.elements.get()+vecOffset+copyCols, boValsMap+valOffset);
-
-            vecOffset += tile->cols(); // vecX partition size can vary between titles
-            valOffset += vecBlocks*blockSize;
-            // copy nnz values the tile into values
-            valOffset += nnzBlocks*blockSize;
+        packed.validTiles = valid_tile;
+
+        if (packed.validTiles != plans[i].validTiles || packed.vecBlocks != plans[i].vecBlocks ||
+                packed.nnzBlocks != plans[i].nnzBlocks || packed.colBlocks != plans[i].colBlocks ||
+                packed.prodBlocks != plans[i].prodBlocks || packed.rowBlocks != plans[i].rowBlocks ||
+                packed.tileBlocks != plans[i].tileBlocks) {
+            std::cout<< "Error: cu: " << i << ", buffer plan mismatch: " 
+                << packed.indicesBytes(blockSize) << " vs. " << plans[i].indicesBytes(blockSize) << " index bytes, "
+                << packed.valuesBytes(sizeof(T), blockSize) << " vs. " << plans[i].valuesBytes(sizeof(T), blockSize) 
+                << " value bytes" << std::endl;
+            return false;
         }
     }
+    return true;
 }
 
 template <typename T> 
@@ -270,59 +657,126 @@ void VerifyTilesPacking(
         std::vector<xrt::bo> &boIndices,
         std::vector<xrt::bo> &boValues, 
         std::vector<std::vector<CSRMatrix<T>*>> &tiles,
-        std::vector<uint> &validTiles,
-        uint maxRowBlocks, 
+        std::vector<std::vector<int>> &tileFormats,
+        std::vector<CuBufferPlan> &plans,
         uint maxVecBlocks, 
         uint blockSize) { 
 
     bool equality = true;
     for (int partInd=0; partInd<tiles.size(); partInd++){
+        if (!plans[partInd].validTiles) continue; // No buffers, see AllocateBuffers()
 
         auto boValsMap = boValues[partInd].map<T*>(); 
         auto boIndicesMap = boIndices[partInd].map<int*>();
-        auto yPart = DenseVector<T>(maxRowBlocks*blockSize, 0); // unpacking mult. result
-        auto yRef = DenseVector<T>(maxRowBlocks*blockSize, 0); // ref mult. result
+        uint yBlocks = plans[partInd].yBlocks;
+        auto yPart = DenseVector<T>(yBlocks*blockSize, 0); // unpacking mult. result
+        auto yRef = DenseVector<T>(yBlocks*blockSize, 0); // ref mult. result
 
-        uint valOffset = 0; // (x vector part + nnz vals)*tiles + result y part
-        uint indOffset = 0; // (row ptr part + nnz cols)*tiles
-        uint nnzTileBlks = ((validTiles[partInd]-1)/blockSize)+1;
-        indOffset += nnzTileBlks*blockSize; // for nnzs in blocks
+        uint xOffset = 0; // x vector part*tiles + nnz vals*tiles + result y part
+        uint valOffset = plans[partInd].valOffset(blockSize);
+        uint indOffset = 0; // (row entries + nnz cols)*tiles
+        uint descOffset = 0;
+        indOffset += blockSize; // for nnzs in blocks
 
-        for (int ind_tile=0; ind_tile<tiles[partInd].size(); ind_tile++) {
+        for (int ind_tile=0, valid_tile=0; ind_tile<tiles[partInd].size(); ind_tile++) {
             // std::cout<< "tile: " << ind_tile << std::endl;
-            int nnzBlocks = boIndicesMap[ind_tile]; // Read number of nnz in the current tile
+            if (!tiles[partInd][ind_tile]->nnz()) continue; // Empty tiles are not packed
+            if (valid_tile && valid_tile%blockSize == 0) { // Next block of tile descriptors
+                descOffset = indOffset;
+                indOffset += blockSize;
+            }
+            yPart.setAll(0);
+            yRef.setAll(0);
+            int tileDesc = boIndicesMap[descOffset+valid_tile%blockSize]; // Read number of nnz in the current tile
+            int nnzBlocks = tileDesc & TILE_BLOCKS_MASK;
+            int format = tileDesc >> TILE_FORMAT_SHIFT;
+            valid_tile++;
+            if (format != tileFormats[partInd][ind_tile]) {
+                std::cout<< "tile: " << partInd << ", " << ind_tile << ", format mismatch warning: " << format 
+                    << " vs. " << tileFormats[partInd][ind_tile] << std::endl;
+            }
             auto xPart = DenseVector<T>(maxVecBlocks*blockSize, 0); 
-            auto rowPart = DenseVector<uint>(maxRowBlocks*blockSize, 0);
+            auto rowPart = DenseVector<uint>(yBlocks*blockSize+1, 0);
 
             // Read vector part.
-            std::copy(boValsMap+valOffset, boValsMap+valOffset+maxVecBlocks*blockSize, xPart.elements.get());
-            valOffset += maxVecBlocks*blockSize;
-
-            // Read row_ptr part.
-            std::copy(boIndicesMap+indOffset, boIndicesMap+indOffset+maxRowBlocks*blockSize, rowPart.elements.get());
-            indOffset += maxRowBlocks*blockSize;
-
-            // Read all the cols and nnzs for the row and multiply
-            for (int row=0, z=0; row<tiles[partInd][0]->rows(); row++) {
-                // std::cout<< "row: " << row << ", ";
-                int nnzPacked = rowPart[row+1] - rowPart[row];
-                int nnzOrig = tiles[partInd][ind_tile]->getRowPointer(row+1) - tiles[partInd][ind_tile]->getRowPointer(row);
-                
-                if (nnzPacked != nnzOrig)  {
-                    std::cout<< "tile: " << partInd << ", " << ind_tile << ", row: " << row;
-                    std::cout<< ", nnz count mismatch warning: " << nnzPacked << " vs. " << nnzOrig << std::endl;
+            std::copy(boValsMap+xOffset, boValsMap+xOffset+maxVecBlocks*blockSize, xPart.elements.get());
+            xOffset += maxVecBlocks*blockSize;
+
+            int colBlocks = nnzBlocks;
+            if (format == TILE_FORMAT_COO) { // The end entry alone, then the nnz with their rows
+                indOffset += blockSize;
+                for (int ind=0; ind<nnzBlocks*blockSize; ind++) {
+                    int entry = boIndicesMap[indOffset+ind];
+                    yPart[entry >> ROW_ENTRY_SHIFT] += boValsMap[ind+valOffset] * xPart[entry & ((1 << ROW_ENTRY_SHIFT)-1)];
                 }
+            } else if (format != TILE_FORMAT_CSR) { // Slice entries, then the slices' blocks in lane order
+                int entries = 0;
+                for (; boIndicesMap[indOffset+entries] != ROW_ENTRY_END; entries++);
+                int sliceOffset = indOffset + ((entries/blockSize)+1)*blockSize, block = 0;
+                for (int entry=0; entry<entries; entry++) {
+                    int first = boIndicesMap[indOffset+entry] >> ROW_ENTRY_SHIFT;
+                    int width = boIndicesMap[indOffset+entry] & (ROW_ENTRY_SLICE-1);
+                    for (int k=0; k<width; k++, block++) {
+                        for (int lane=0; lane<blockSize; lane++) {
+                            int ind = block*blockSize+lane;
+                            if (format == TILE_FORMAT_BCSR) {
+                                int blockEntry = boIndicesMap[sliceOffset+block];
+                                int row = first + (blockEntry >> ROW_ENTRY_SHIFT)*(blockSize/BCSR_C) + lane/BCSR_C;
+                                int col = (blockEntry & ((1 << ROW_ENTRY_SHIFT)-1)) + lane%BCSR_C;
+                                yPart[row] += boValsMap[ind+valOffset] * xPart[col];
+                            } else if (format == TILE_FORMAT_DIA) { // Padding lanes hold zeros
+                                int col = first + lane + boIndicesMap[sliceOffset+k];
+                                yPart[first+lane] += col >= 0 && col < xPart.size() ? boValsMap[ind+valOffset] * xPart[col] : 0;
+                            } else {
+                                yPart[first+lane] += boValsMap[ind+valOffset] * xPart[boIndicesMap[ind+sliceOffset]];
+                            }
+                        }
+                    }
+                }
+                if (block != nnzBlocks) {
+                    std::cout<< "tile: " << partInd << ", " << ind_tile << ", slice blocks mismatch warning: " 
+                        << block << " vs. " << nnzBlocks << std::endl;
+                }
+                if (format == TILE_FORMAT_BCSR) {
+                    colBlocks = ((nnzBlocks-1)/blockSize)+1;
+                } else if (format == TILE_FORMAT_DIA) {
+                    colBlocks = 1;
+                }
+                indOffset = sliceOffset;
+            } else {
+                // Read row entries part, into a row pointer.
+                int entry = 0;
+                for (; boIndicesMap[indOffset+entry] != ROW_ENTRY_END; entry++) {
+                    int row = boIndicesMap[indOffset+entry] >> ROW_ENTRY_SHIFT;
+                    rowPart[row+1] = boIndicesMap[indOffset+entry] & ((1 << ROW_ENTRY_SHIFT)-1);
+                }
+                for (int row=0; row<tiles[partInd][ind_tile]->rows(); row++) {
+                    rowPart[row+1] += rowPart[row];
+                }
+                indOffset += ((entry/blockSize)+1)*blockSize;
+
+                // Read all the cols and nnzs for the row and multiply
+                for (int row=0, z=0; row<tiles[partInd][0]->rows(); row++) {
+                    // std::cout<< "row: " << row << ", ";
+                    int nnzPacked = rowPart[row+1] - rowPart[row];
+                    int nnzOrig = tiles[partInd][ind_tile]->getRowPointer(row+1) - tiles[partInd][ind_tile]->getRowPointer(row);
                 
-                for (int ind=rowPart[row]; ind<rowPart[row+1]; ind++, z++) {
-                    if (boValsMap[ind+valOffset] != tiles[partInd][ind_tile]->getData(z))
-                        std::cout<< "values mismatch warning: " << boValsMap[ind+valOffset] << " vs. " << tiles[partInd][ind_tile]->getData(z) << std::endl;
-                    if (boIndicesMap[ind+indOffset] != tiles[partInd][ind_tile]->getColIndex(z)) 
-                        std::cout<< "col mismatch warning: " << boIndicesMap[ind+indOffset] << " vs. " << tiles[partInd][ind_tile]->getColIndex(z) << std::endl;
-                    yPart[row] += boValsMap[ind+valOffset] * xPart[boIndicesMap[ind+indOffset]];
+                    if (nnzPacked != nnzOrig)  {
+                        std::cout<< "tile: " << partInd << ", " << ind_tile << ", row: " << row;
+                        std::cout<< ", nnz count mismatch warning: " << nnzPacked << " vs. " << nnzOrig << std::endl;
+                    }
+                
+                    for (int ind=rowPart[row]; ind<rowPart[row+1]; ind++, z++) {
+                        if (boValsMap[ind+valOffset] != tiles[partInd][ind_tile]->getData(z))
+                            std::cout<< "values mismatch warning: " << boValsMap[ind+valOffset] << " vs. " << tiles[partInd][ind_tile]->getData(z) << std::endl;
+                        if (boIndicesMap[ind+indOffset] != tiles[partInd][ind_tile]->getColIndex(z)) 
+                            std::cout<< "col mismatch warning: " << boIndicesMap[ind+indOffset] << " vs. " << tiles[partInd][ind_tile]->getColIndex(z) << std::endl;
+                        yPart[row] += boValsMap[ind+valOffset] * xPart[boIndicesMap[ind+indOffset]];
+                    }
                 }
             }
             valOffset += nnzBlocks*blockSize;
-            indOffset += nnzBlocks*blockSize;
+            indOffset += colBlocks*blockSize;
             matrixVectorMult<T>(*tiles[partInd][ind_tile], xPart, yRef);
             equality &= vectorNorm(yPart) == vectorNorm(yRef);
             if (!equality) {
@@ -336,4 +790,39 @@ void VerifyTilesPacking(
         }
     }
     std::cout<< "verifyTilesPacking(): norm of partition equality: " << equality << std::endl;
-}
\ No newline at end of file
+}
+
+// Decodes and prints the counter blocks of the last launch behind each launched CU's y partition, 
+// from its values buffer (synced from the device)
+void ReportPerfCounters(
+        std::vector<xrt::bo> &boValues,
+        std::vector<CuBufferPlan> &plans,
+        uint blockSize) {
+
+    const char* names[PERF_BLOCKS] = {"csr_spmv_repl_1", "csr_spmv_repl_2", "csr_spmv_repl_3", "csr_spmv_repl_4"};
+    for (int i=0; i<boValues.size(); i++) {
+        if (!plans[i].validTiles) continue; // Not launched
+        auto perfMap = boValues[i].map<uint*>() + plans[i].perfOffset(blockSize);
+        int busiest = -1;
+        for (int k=0; k<PERF_BLOCKS; k++) {
+            auto counters = perfMap + k*blockSize;
+            if (counters[PERF_KERNEL_INDEX] != k+1) {
+                std::cout << "perf_counters[" << i << "]: invalid block of " << names[k] << std::endl;
+                busiest = -1;
+                break;
+            }
+            std::cout << "perf_counters[" << i << "][" << k+1 << "]: kernel: " << names[k]
+                << ", active_cycles: " << counters[PERF_ACTIVE_INDEX]
+                << ", in_stalls: " << counters[PERF_IN_STALL_INDEX]
+                << ", out_stalls: " << counters[PERF_OUT_STALL_INDEX]
+                << ", blocks: " << counters[PERF_BLOCKS_INDEX]
+                << ", tiles: " << counters[PERF_TILES_INDEX] << std::endl;
+            if (busiest < 0 || counters[PERF_ACTIVE_INDEX] > perfMap[busiest*blockSize+PERF_ACTIVE_INDEX]) {
+                busiest = k;
+            }
+        }
+        if (busiest >= 0) {
+            std::cout << "perf_counters_busiest[" << i << "]: " << names[busiest] << std::endl;
+        }
+    }
+}
@@ -22,6 +22,14 @@ ID := 1
 # Temp. Id for linking config file
 CFGID := 1
 
+# On-chip buffer variant: 1 = x and y buffers in URAM (see xlx_definitions.hpp), linked with single.2.cfg
+URAM := 0
+
+ifeq ($(URAM), 1)
+ID := uram
+CFGID := 2
+endif
+
 # XRT and VIVADO includes and libs
 XRT_INCLUDE:= $(XILINX_XRT)/include
 XRT_LIBS:= $(XILINX_XRT)/lib/
@@ -63,6 +71,20 @@ XLX_SPMV_HOST_SRC := $(XLX_ROOT)/xlx_spmv_host.cpp
 
 XLX_SPMV_HOST_BIN := $(BIN_DIR)/xilinx_spmv_host
 
+# CPU simulation: the host and kernels built against the HLS/XRT stand-ins in src/csim, no Vitis/XRT needed.
+# The "xclbin" of the simulation is the link config, whose nk= and sc= lines define the CUs and their FIFOs.
+XLX_CSIM_ROOT := $(XLX_ROOT)/csim
+
+XLX_SPMV_CSIM_SRC := $(XLX_SPMV_HOST_SRC) $(XLX_CSIM_ROOT)/xrt_csim.cpp 
+XLX_SPMV_CSIM_SRC += $(XLX_ROOT)/kernels/csr_spmv_repl_1.cpp $(XLX_ROOT)/kernels/csr_spmv_repl_2.cpp
+XLX_SPMV_CSIM_SRC += $(XLX_ROOT)/kernels/csr_spmv_repl_3_1.cpp $(XLX_ROOT)/kernels/csr_spmv_repl_3_2.cpp
+XLX_SPMV_CSIM_SRC += $(XLX_ROOT)/kernels/csr_spmv_caps.cpp
+
+XLX_SPMV_CSIM_BIN := $(BIN_DIR)/xilinx_spmv_csim
+
+CXXFLAGS_CSIM := -I'$(XLX_CSIM_ROOT)/include' -I'$(XLX_ROOT)/kernels' -I'$(SRC_ROOT)' -I'$(INC_ROOT)'
+CXXFLAGS_CSIM += -DTARGET=sw_emu -D URAM=$(URAM) -O2 -std=c++17 -pthread -fmessage-length=0
+
 # VPP temp dir, to keep the obj and report files
 XLX_TEMP_DIR := $(BIN_DIR)/temp_dir.$(TARGET).$(ID)
 
@@ -71,6 +93,7 @@ XLX_BUILD_DIR := $(BIN_DIR)/build_dir.$(TARGET).$(ID)
 
 VPP_FLAGS := --platform $(PLATFORM) --target $(TARGET) --optimize $(O)
 VPP_FLAGS += --temp_dir $(XLX_TEMP_DIR) -I'$(SRC_ROOT)' -I'$(INC_ROOT)' -I'$(SRC_REF)' --save-temps
+VPP_FLAGS += -D URAM=$(URAM)
 
 XLX_KRN_DIR := $(XLX_ROOT)/kernels
 
@@ -82,6 +105,9 @@ XLX_KRN_DIR := $(XLX_ROOT)/kernels
 ## Model 2
 XLX_SPMV_CSR_MODEL_2_REP := csr_spmv_repl
 
+## Capacity query kernel, read by the host for the xclbin limits
+XLX_SPMV_CAPS := csr_spmv_caps
+
 # !!!! Comment out the kernels you don't want to incldue in the xclbin !!!!
 
 ###### Model 2: 4 kernel replicated x
@@ -89,6 +115,7 @@ XLX_SINGLE_OBJS += $(XLX_TEMP_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_s_1.xo
 XLX_SINGLE_OBJS += $(XLX_TEMP_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_s_2.xo
 XLX_SINGLE_OBJS += $(XLX_TEMP_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_s_3_1.xo
 XLX_SINGLE_OBJS += $(XLX_TEMP_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_s_3_2.xo
+XLX_SINGLE_OBJS += $(XLX_TEMP_DIR)/$(XLX_SPMV_CAPS).xo
 
 # One xclbin to contain all single versions
 XLX_SINGLE_XCLBIN := $(XLX_BUILD_DIR)/hihi_spmv.xclbin
@@ -104,6 +131,8 @@ $(XLX_TEMP_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_s_3_1.xo: $(XLX_KRN_DIR)/$(XLX_SPMV_
 	$(VPP) $(VPP_FLAGS) --config '$(<D)/$(XLX_SPMV_CSR_MODEL_2_REP).cfg' -c -k csr_spmv_repl_3 -I'$(XLX_KRN_DIR)' -o'$@' '$<'
 $(XLX_TEMP_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_s_3_2.xo: $(XLX_KRN_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_3_2.cpp .pre_xilinx
 	$(VPP) $(VPP_FLAGS) --config '$(<D)/$(XLX_SPMV_CSR_MODEL_2_REP).cfg' -c -k csr_spmv_repl_4 -I'$(XLX_KRN_DIR)' -o'$@' '$<'
+$(XLX_TEMP_DIR)/$(XLX_SPMV_CAPS).xo: $(XLX_KRN_DIR)/$(XLX_SPMV_CAPS).cpp .pre_xilinx
+	$(VPP) $(VPP_FLAGS) -c -k $(XLX_SPMV_CAPS) -I'$(XLX_KRN_DIR)' -o'$@' '$<'
 
 # XCLBIN compilation targets 
 $(XLX_SINGLE_XCLBIN): $(XLX_SINGLE_OBJS)
@@ -113,6 +142,7 @@ $(XLX_SINGLE_XCLBIN): $(XLX_SINGLE_OBJS)
 # k2: $(XLX_TEMP_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_s_2.xo
 # k3: $(XLX_TEMP_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_s_3_1.xo
 # k4: $(XLX_TEMP_DIR)/$(XLX_SPMV_CSR_MODEL_2_REP)_s_3_2.xo
+# caps: $(XLX_TEMP_DIR)/$(XLX_SPMV_CAPS).xo
 
 check_xilinx:
 	ifndef XILINX_VIVADO